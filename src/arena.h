@@ -0,0 +1,100 @@
+/*** arena.h -- bump allocated byte arenas
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_arena_h_
+#define INCLUDED_arena_h_
+
+#include <stddef.h>
+#include <string.h>
+
+/* A growable byte buffer handing out offsets rather than pointers,
+ * so it may move when growing.  Resetting is O(1). */
+struct arena_s {
+	char *buf;
+	size_t n;
+	size_t z;
+};
+
+#define ARENA_NIL	((size_t)-1)
+
+/**
+ * Make room for Z more bytes in A. */
+extern int arena_grow(struct arena_s *restrict a, size_t z);
+
+extern void arena_fini(struct arena_s *restrict a);
+
+
+/**
+ * Reserve Z bytes in A and return their offset, or ARENA_NIL. */
+static inline size_t
+arena_alloc(struct arena_s *restrict a, size_t z)
+{
+	const size_t o = a->n;
+
+	if (__builtin_expect(o + z > a->z, 0) && arena_grow(a, z) < 0) {
+		return ARENA_NIL;
+	}
+	a->n += z;
+	return o;
+}
+
+/**
+ * Append a copy of the Z bytes at S to A and return their offset. */
+static inline size_t
+arena_add(struct arena_s *restrict a, const void *s, size_t z)
+{
+	const size_t o = arena_alloc(a, z);
+
+	if (__builtin_expect(o != ARENA_NIL, 1)) {
+		memcpy(a->buf + o, s, z);
+	}
+	return o;
+}
+
+static inline void*
+arena_ptr(const struct arena_s *a, size_t o)
+{
+	return a->buf + o;
+}
+
+static inline void
+arena_reset(struct arena_s *restrict a)
+{
+	a->n = 0U;
+	return;
+}
+
+#endif	/* INCLUDED_arena_h_ */
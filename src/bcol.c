@@ -0,0 +1,201 @@
+/*** bcol.c -- binary columnar output
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "bcol.h"
+#include "arena.h"
+#include "nifty.h"
+
+/* flush early when a string column has this many bytes */
+#define BCOL_MAXZ	(1U << 30U)
+
+struct col_s {
+	typ_t t;
+	/* fixed-size values, or the string end offsets */
+	struct arena_s d;
+	/* string bytes */
+	struct arena_s s;
+};
+
+struct bcol_s {
+	size_t ncol;
+	uint32_t nrow;
+	/* set when some string column is getting large */
+	int bigp;
+	struct col_s c[];
+};
+
+static const char magic[8U] = "DTCLCOL1";
+
+
+bcol_t
+bcol_open(size_t ncol, const typ_t *typ)
+{
+	bcol_t b = calloc(1U, sizeof(*b) + ncol * sizeof(*b->c));
+
+	if (UNLIKELY(b == NULL)) {
+		return NULL;
+	}
+	b->ncol = ncol;
+	for (size_t i = 0U; i < ncol; i++) {
+		b->c[i].t = typ[i];
+	}
+	return b;
+}
+
+void
+bcol_close(bcol_t b)
+{
+	for (size_t i = 0U; i < b->ncol; i++) {
+		arena_fini(&b->c[i].d);
+		arena_fini(&b->c[i].s);
+	}
+	free(b);
+	return;
+}
+
+void
+bcol_add(bcol_t b, size_t i, const char *s, size_t z)
+{
+	struct col_s *c = b->c + i;
+	typv_t v;
+
+	if (c->t == TYP_STR) {
+		uint32_t e;
+
+		arena_add(&c->s, s, z);
+		e = (uint32_t)c->s.n;
+		arena_add(&c->d, &e, sizeof(e));
+		b->bigp |= c->s.n >= BCOL_MAXZ;
+		return;
+	}
+	(void)typ_parse(&v, c->t, s, z);
+	bcol_val(b, i, v);
+	return;
+}
+
+void
+bcol_val(bcol_t b, size_t i, typv_t v)
+{
+	struct col_s *c = b->c + i;
+
+	switch (c->t) {
+	case TYP_INT:
+		arena_add(&c->d, &v.i, sizeof(v.i));
+		break;
+	case TYP_DBL:
+		arena_add(&c->d, &v.d, sizeof(v.d));
+		break;
+	case TYP_DATE:
+		arena_add(&c->d, &v.t, sizeof(v.t));
+		break;
+	default:
+		/* only strings can carry strings */
+		bcol_add(b, i, NULL, 0U);
+		break;
+	}
+	return;
+}
+
+int
+bcol_row(bcol_t b)
+{
+	return ++b->nrow >= BCOL_NROW || b->bigp;
+}
+
+void
+bcol_flush(bcol_t b, obuf_t o)
+{
+	static const uint32_t nul = 0U;
+
+	if (!b->nrow) {
+		return;
+	}
+	obuf_add(o, (const void*)&b->nrow, sizeof(b->nrow));
+	for (size_t i = 0U; i < b->ncol; i++) {
+		struct col_s *c = b->c + i;
+
+		if (c->t == TYP_STR) {
+			obuf_add(o, (const void*)&nul, sizeof(nul));
+		}
+		obuf_add(o, c->d.buf, c->d.n);
+		obuf_add(o, c->s.buf, c->s.n);
+		arena_reset(&c->d);
+		arena_reset(&c->s);
+	}
+	b->nrow = 0U;
+	b->bigp = 0;
+	return;
+}
+
+void
+bcol_hdr(obuf_t o, size_t ncol)
+{
+	const uint32_t bom = 0x01020304U;
+	const uint32_t n = (uint32_t)ncol;
+
+	obuf_add(o, magic, sizeof(magic));
+	obuf_add(o, (const void*)&bom, sizeof(bom));
+	obuf_add(o, (const void*)&n, sizeof(n));
+	return;
+}
+
+void
+bcol_name(obuf_t o, typ_t t, const char *s, size_t z)
+{
+	const uint32_t n = (uint32_t)z;
+
+	obuf_chr(o, (char)t);
+	obuf_add(o, (const void*)&n, sizeof(n));
+	obuf_add(o, s, z);
+	return;
+}
+
+void
+bcol_end(obuf_t o)
+{
+	static const uint32_t nul = 0U;
+
+	obuf_add(o, (const void*)&nul, sizeof(nul));
+	return;
+}
+
+/* bcol.c ends here */
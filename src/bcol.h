@@ -0,0 +1,104 @@
+/*** bcol.h -- binary columnar output
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_bcol_h_
+#define INCLUDED_bcol_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "typ.h"
+#include "obuf.h"
+
+/* A binary columnar stream, integers are in native byte order:
+ *
+ *   stream := header block* end
+ *   header := "DTCLCOL1" bom:u32 ncol:u32 (type:u8 namez:u32 name)*ncol
+ *   block  := nrow:u32 column*ncol	(nrow > 0)
+ *   end    := 0:u32
+ *
+ * BOM is 0x01020304 so readers can tell the byte order, types are the
+ * typ_t codes, and each column's data, by type, is:
+ *
+ *   int    nrow int64s, TYP_NA_INT if missing
+ *   float  nrow doubles, NaN if missing
+ *   date   nrow int32s, days since 1970-01-01, TYP_NA_DATE if missing
+ *   str    nrow + 1 u32 offsets into the bytes that follow, then the
+ *          bytes, missing values are empty
+ *
+ * Rows are collected column-wise and written out in blocks. */
+typedef struct bcol_s *bcol_t;
+
+/* rows per block */
+#define BCOL_NROW	(4096U)
+
+/**
+ * Set up a block for NCOL columns of types TYP. */
+extern bcol_t bcol_open(size_t ncol, const typ_t *typ);
+
+extern void bcol_close(bcol_t b);
+
+/**
+ * Append S of size Z to column I of the current row of B, parsing it
+ * as per the column's type.  Values that don't parse are missing. */
+extern void bcol_add(bcol_t b, size_t i, const char *s, size_t z);
+
+/**
+ * Append V to column I of the current row of B. */
+extern void bcol_val(bcol_t b, size_t i, typv_t v);
+
+/**
+ * Finish the current row of B.
+ * Return non-0 if the block is full and should be flushed. */
+extern int bcol_row(bcol_t b);
+
+/**
+ * Write the rows of B as block to O and start afresh. */
+extern void bcol_flush(bcol_t b, obuf_t o);
+
+/**
+ * Write the stream header for NCOL columns to O,
+ * to be followed by NCOL calls to bcol_name(). */
+extern void bcol_hdr(obuf_t o, size_t ncol);
+
+/**
+ * Write the name S of size Z of a column of type T to O. */
+extern void bcol_name(obuf_t o, typ_t t, const char *s, size_t z);
+
+/**
+ * Write the end of stream marker to O. */
+extern void bcol_end(obuf_t o);
+
+#endif	/* INCLUDED_bcol_h_ */
@@ -39,7 +39,9 @@
 
 #include <unistd.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "coru/cocore.h"
+#include "coth.h"
 
 #if !defined _paste
 # define _paste(x, y)		x ## y
@@ -59,10 +61,32 @@
 			(ctx), sizeof(*(ctx)),				\
 			next, 0U, false, 0);				\
 	})
+/* like START() but run X on a thread of its own, see coth.h,
+ * items of size Z are passed to NEXT1() by value,
+ * such handles have their lowest bit set */
+#define START_THREAD(x, z, ctx)						\
+	({								\
+		coth_t t = coth_start(					\
+			(coth_action_t)(x),				\
+			(ctx), sizeof(*(ctx)), (z));			\
+		t ? (struct cocore*)((uintptr_t)t | 1U) : NULL;		\
+	})
+#define THREADP(x)	((uintptr_t)(x) & 1U)
+#define THREAD(x)	((coth_t)((uintptr_t)(x) ^ 1U))
 #define SWITCH(x, o)	switch_cocore((x), (void*)(intptr_t)(o))
-#define NEXT1(x, o)	(intptr_t)(check_cocore(x) ? SWITCH(x, o) : NULL)
+#define NEXT1(x, o)							\
+	(THREADP(x)							\
+	 ? coth_next(THREAD(x), (o))					\
+	 : (intptr_t)(check_cocore(x) ? SWITCH(x, o) : NULL))
 #define NEXT(x)		NEXT1(x, NULL)
-#define YIELD(o)	((intptr_t)SWITCH((ctx->next), (o)))
+#define YIELD(o)							\
+	(THREADP(ctx->next)						\
+	 ? coth_yield(THREAD(ctx->next))				\
+	 : (intptr_t)SWITCH((ctx->next), (o)))
+/* memory that lives as long as the next yielded item, threads only */
+#define YALLOC(z)	coth_alloc(THREAD(ctx->next), (z))
+/* stop and join threads, coroutines are left to UNPREP() */
+#define STOP(x)		(THREADP(x) ? coth_close(THREAD(x)) : (void)0)
 #define RETURN(o)	return (intptr_t)(o)
 
 #define DEFCORU(name, closure, arg)			\
@@ -75,5 +99,7 @@
 #define CORU_STRUCT(x)	struct x##_s
 #define PACK(x, args...)	&((CORU_STRUCT(x)){args})
 #define START_PACK(x, args...)	START(x, PACK(x, args))
+#define START_THREAD_PACK(x, z, args...)	\
+	START_THREAD(x, z, PACK(x, args))
 
 #endif	/* INCLUDED_coru_h_ */
@@ -0,0 +1,377 @@
+/*** coth.c -- coroutines on threads of their own
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#if defined HAVE_PTHREAD
+# include <pthread.h>
+#endif	/* HAVE_PTHREAD */
+#include "coth.h"
+#include "nifty.h"
+
+#if defined HAVE_PTHREAD
+/* batches in the ring, items per batch, initial arena size per batch */
+#define NSLOT	(8U)
+#define NITEM	(1024U)
+#define ZBUF	(256U * 1024U)
+/* how often to look before going to sleep */
+#define NSPIN	(256U)
+
+#define LOAD(x)		__atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define STORE(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+struct slot_s {
+	size_t n;
+	char *itm;
+	/* memory handed out by coth_alloc() */
+	char *buf;
+	size_t bi;
+	size_t bz;
+};
+
+struct coth_s {
+	coth_action_t action;
+	void *ctx;
+	void *arg;
+	size_t iz;
+
+	/* batches published by the producer and released by the consumer,
+	 * batch N lives in slot N % NSLOT, neither is ever locked */
+	size_t head;
+	size_t tail;
+	/* producer has returned, consumer has gone */
+	int done;
+	int stop;
+	intptr_t rc;
+
+	/* slot being filled, private to the producer */
+	struct slot_s *fill;
+	/* slot being read and the next item therein, private to the
+	 * consumer */
+	struct slot_s *held;
+	size_t ci;
+
+	/* for sleeping only, producer or consumer sleeping */
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+	int pslp;
+	int cslp;
+	int go;
+	pthread_t thr;
+
+	struct slot_s slot[NSLOT];
+};
+
+static bool
+roomp(struct coth_s *t)
+{
+	return LOAD(t->head) - LOAD(t->tail) < NSLOT || LOAD(t->stop);
+}
+
+static bool
+availp(struct coth_s *t)
+{
+	return LOAD(t->head) > t->tail || LOAD(t->done);
+}
+
+static void
+await(struct coth_s *t, int *slp, bool(*predp)(struct coth_s*))
+{
+	for (size_t i = 0U; i < NSPIN; i++) {
+		if (predp(t)) {
+			return;
+		}
+	}
+	/* the other side looks at SLP after moving its index */
+	pthread_mutex_lock(&t->mtx);
+	STORE(*slp, 1);
+	while (!predp(t)) {
+		pthread_cond_wait(&t->cv, &t->mtx);
+	}
+	STORE(*slp, 0);
+	pthread_mutex_unlock(&t->mtx);
+	return;
+}
+
+static void
+wake(struct coth_s *t, int *slp)
+{
+	if (LOAD(*slp)) {
+		pthread_mutex_lock(&t->mtx);
+		pthread_cond_broadcast(&t->cv);
+		pthread_mutex_unlock(&t->mtx);
+	}
+	return;
+}
+
+static struct slot_s*
+fill(struct coth_s *t)
+{
+/* the producer's current slot, wait for one to become free if need be */
+	if (UNLIKELY(t->fill == NULL)) {
+		await(t, &t->pslp, roomp);
+		t->fill = t->slot + LOAD(t->head) % NSLOT;
+		t->fill->n = 0U;
+		t->fill->bi = 0U;
+	}
+	return t->fill;
+}
+
+static void
+publish(struct coth_s *t)
+{
+	if (t->fill != NULL && t->fill->n) {
+		t->fill = NULL;
+		STORE(t->head, LOAD(t->head) + 1U);
+		wake(t, &t->cslp);
+	}
+	return;
+}
+
+static void*
+coth_main(void *arg)
+{
+	struct coth_s *t = arg;
+
+	pthread_mutex_lock(&t->mtx);
+	while (!t->go) {
+		pthread_cond_wait(&t->cv, &t->mtx);
+	}
+	pthread_mutex_unlock(&t->mtx);
+
+	if (!LOAD(t->stop)) {
+		t->rc = t->action(t->ctx, t->arg);
+	}
+	/* hand over the rest */
+	publish(t);
+	STORE(t->done, 1);
+	wake(t, &t->cslp);
+	return NULL;
+}
+
+
+coth_t
+coth_start(coth_action_t action, const void *ctx, size_t cz, size_t iz)
+{
+	struct coth_s *t;
+
+	if (UNLIKELY((t = calloc(1U, sizeof(*t))) == NULL)) {
+		return NULL;
+	}
+	if (UNLIKELY((t->ctx = malloc(cz)) == NULL)) {
+		goto nomem;
+	} else if (UNLIKELY((t->arg = malloc(iz)) == NULL)) {
+		goto nomem;
+	}
+	for (size_t i = 0U; i < NSLOT; i++) {
+		if (UNLIKELY((t->slot[i].itm = malloc(NITEM * iz)) == NULL)) {
+			goto nomem;
+		}
+	}
+	memcpy(t->ctx, ctx, cz);
+	/* closures start with the fibre handle, tagged as in coru.h */
+	*(uintptr_t*)t->ctx = (uintptr_t)t | 1U;
+	t->action = action;
+	t->iz = iz;
+
+	pthread_mutex_init(&t->mtx, NULL);
+	pthread_cond_init(&t->cv, NULL);
+	if (UNLIKELY(pthread_create(&t->thr, NULL, coth_main, t))) {
+		pthread_cond_destroy(&t->cv);
+		pthread_mutex_destroy(&t->mtx);
+		goto nomem;
+	}
+	return t;
+
+nomem:
+	for (size_t i = 0U; i < NSLOT; i++) {
+		free(t->slot[i].itm);
+	}
+	free(t->arg);
+	free(t->ctx);
+	free(t);
+	return NULL;
+}
+
+intptr_t
+coth_next(coth_t t, void *tgt)
+{
+	if (UNLIKELY(!t->go)) {
+		/* like coroutines, start on the first request */
+		pthread_mutex_lock(&t->mtx);
+		t->go = 1;
+		pthread_cond_broadcast(&t->cv);
+		pthread_mutex_unlock(&t->mtx);
+	}
+	for (;;) {
+		intptr_t rc;
+
+		if (LIKELY(t->held != NULL)) {
+			if (LIKELY(t->ci < t->held->n)) {
+				memcpy(tgt, t->held->itm + t->ci++ * t->iz,
+				       t->iz);
+				return 1;
+			}
+			/* done with this batch */
+			t->held = NULL;
+			STORE(t->tail, t->tail + 1U);
+			wake(t, &t->pslp);
+		}
+		await(t, &t->cslp, availp);
+		if (LOAD(t->head) > t->tail) {
+			t->held = t->slot + t->tail % NSLOT;
+			t->ci = 0U;
+			continue;
+		}
+		/* the producer's return value is reported just once */
+		rc = t->rc;
+		t->rc = 0;
+		return rc;
+	}
+}
+
+void
+coth_close(coth_t t)
+{
+	STORE(t->stop, 1);
+	pthread_mutex_lock(&t->mtx);
+	t->go = 1;
+	pthread_cond_broadcast(&t->cv);
+	pthread_mutex_unlock(&t->mtx);
+	pthread_join(t->thr, NULL);
+
+	pthread_cond_destroy(&t->cv);
+	pthread_mutex_destroy(&t->mtx);
+	for (size_t i = 0U; i < NSLOT; i++) {
+		free(t->slot[i].itm);
+		free(t->slot[i].buf);
+	}
+	free(t->arg);
+	free(t->ctx);
+	free(t);
+	return;
+}
+
+intptr_t
+coth_yield(coth_t t)
+{
+	struct slot_s *s = fill(t);
+
+	memcpy(s->itm + s->n++ * t->iz, t->arg, t->iz);
+	if (UNLIKELY(s->n >= NITEM)) {
+		publish(t);
+	}
+	return LOAD(t->stop) ? -1 : 1;
+}
+
+void*
+coth_alloc(coth_t t, size_t z)
+{
+	struct slot_s *s = fill(t);
+	void *p;
+
+	/* keep things aligned */
+	z = (z + 15U) & ~(size_t)15U;
+	if (UNLIKELY(s->bi + z > s->bz)) {
+		if (s->n) {
+			/* this one's full, continue in a fresh batch */
+			publish(t);
+			s = fill(t);
+		}
+		if (z > s->bz - s->bi) {
+			/* no items yet, so nothing points here */
+			free(s->buf);
+			s->bz = z > ZBUF ? z : ZBUF;
+			s->bi = 0U;
+			if (UNLIKELY((s->buf = malloc(s->bz)) == NULL)) {
+				s->bz = 0U;
+				return NULL;
+			}
+		}
+	}
+	p = s->buf + s->bi;
+	s->bi += z;
+	return p;
+}
+
+#else  /* !HAVE_PTHREAD */
+coth_t
+coth_start(coth_action_t action, const void *ctx, size_t cz, size_t iz)
+{
+	(void)action;
+	(void)ctx;
+	(void)cz;
+	(void)iz;
+	return NULL;
+}
+
+intptr_t
+coth_next(coth_t t, void *tgt)
+{
+	(void)t;
+	(void)tgt;
+	return 0;
+}
+
+void
+coth_close(coth_t t)
+{
+	(void)t;
+	return;
+}
+
+intptr_t
+coth_yield(coth_t t)
+{
+	(void)t;
+	return -1;
+}
+
+void*
+coth_alloc(coth_t t, size_t z)
+{
+	(void)t;
+	(void)z;
+	return NULL;
+}
+#endif	/* HAVE_PTHREAD */
+
+/* coth.c ends here */
@@ -0,0 +1,86 @@
+/*** coth.h -- coroutines on threads of their own
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_coth_h_
+#define INCLUDED_coth_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A producer coroutine may run on a thread of its own.  What it yields
+ * is copied into batches which are handed to the consumer through a
+ * single-producer single-consumer ring, so producer and consumer only
+ * meet once per batch. */
+typedef struct coth_s *coth_t;
+
+/**
+ * Producer body, CTX is its closure which starts with a pointer to the
+ * coth object (tagged, see coru.h), ARG the item to fill before each
+ * coth_yield().  Non-positive return values end the stream. */
+typedef intptr_t(*coth_action_t)(void *ctx, void *arg);
+
+/**
+ * Prepare ACTION to run on a thread with a copy of closure CTX of size
+ * CZ, handing over items of size IZ.
+ * The thread is started by the first coth_next().
+ * Return NULL if threads aren't supported or cannot be created. */
+extern coth_t coth_start(coth_action_t action, const void *ctx, size_t cz,
+			 size_t iz);
+
+/**
+ * Copy the next item of T to TGT.
+ * Return 1 if there was one, or the producer's return value otherwise.
+ * The previous item, and memory allocated along with it, stays valid
+ * until the next call. */
+extern intptr_t coth_next(coth_t t, void *tgt);
+
+/**
+ * Stop and join the producer of T and free all resources.
+ * Items obtained from T must not be used afterwards. */
+extern void coth_close(coth_t t);
+
+/**
+ * For producers, append the current item to the batch.
+ * Return 1, or -1 if the consumer has gone. */
+extern intptr_t coth_yield(coth_t t);
+
+/**
+ * For producers, return Z bytes that live as long as the next item
+ * yielded, or NULL if out of memory.
+ * Memory for an item must be asked for in one go. */
+extern void *coth_alloc(coth_t t, size_t z);
+
+#endif	/* INCLUDED_coth_h_ */
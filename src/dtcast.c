@@ -42,33 +42,107 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <unistd.h>
 #include <errno.h>
+#include "tok.h"
+#include "rdln.h"
+#include "obuf.h"
+#include "htab.h"
+#include "hash.h"
+#include "arena.h"
+#include "ppln.h"
+#include "typ.h"
+#include "bcol.h"
 #include "nifty.h"
 
 static int hdrp = 0;
 static int cnmp = 0;
+/* buffered stdout */
+static obuf_t ob;
 /* number of cast columns */
 static size_t ncc;
 static size_t zcc;
 /* cast column hash values */
 static uint64_t *cc;
+/* index into CC */
+static struct htab_s ccx;
+/* cast column keys, tab separated, key J spans [CKO[J], CKO[J + 1U]) */
+static struct arena_s cka;
+static size_t *cko;
 static const char **cn;
-/* number of distinct values per cast column */
-static size_t *nccv;
-/* total size of allocated ccv */
-static size_t *zccv;
-/* base pointers per per cast column */
-static char **ccv;
-static size_t *zccvo;
-/* offsets per cast column
- * for each molten line we determine c<-CC(id-col), the index of the
- * cast column as per id variable then store CCV[c] + CCVO[c][nccv]
- * the value */
-static size_t **ccvo;
-/* buffer of the dimension line (LHS) */
-static size_t ndim;
-static size_t zdim;
-static char *dim;
+/* with --sort-cast, position of cast column J in the output, CCR[J],
+ * and the cast column at output position I, CCP[I] */
+static int scap;
+static size_t *ccr;
+static size_t *ccp;
+/* types of the value fields, NULL for plain text, TYP_NIL ones are
+ * inferred from the first lines of the input */
+static typ_t *vtyp;
+static size_t ntyp;
+/* binary columnar output, NBC columns of types BTYP */
+static int binp;
+static typ_t *btyp;
+static size_t nbc;
+/* aggregation of values per cell */
+static enum {
+	AGG_NONE,
+	AGG_SUM,
+	AGG_MEAN,
+	AGG_MIN,
+	AGG_MAX,
+	AGG_FIRST,
+	AGG_LAST,
+	AGG_COUNT,
+} aggf;
+struct agg_s {
+	double x;
+	size_t n;
+};
+/* a cell, the value of cast column J, Z bytes at offset O */
+struct cel_s {
+	size_t j;
+	size_t o;
+	size_t z;
+};
+/* values of the current group, one per worker */
+struct grp_s {
+	/* for each molten line we determine c<-CC(id-col), the index of the
+	 * cast column as per id variable, then append the cell (c, value)
+	 * to CEL and the value itself to VAL, both are reset per group */
+	struct arena_s cel;
+	struct arena_s val;
+	/* cells gathered by cast column for printing, the cells of the
+	 * column at output position J are GC[GO[J]] up to GC[GO[J + 1U]] */
+	struct cel_s *gc;
+	size_t zgc;
+	size_t *go;
+	size_t zgo;
+	/* output positions of the non-empty cast columns, and the cell to
+	 * print next for each of them, both of capacity ZGC */
+	size_t *ne;
+	size_t *nm;
+	/* row template, a separator per value field per cast column
+	 * and the newline */
+	char *tl;
+	size_t ntl;
+	/* accumulators, one per value hand side field per cast column,
+	 * column J's are in use for this group iff CAG[J] == AGN */
+	struct agg_s *cca;
+	size_t *cag;
+	size_t agn;
+	/* rows for binary output */
+	bcol_t bc;
+	/* buffer of the dimension line (LHS) */
+	size_t ndim;
+	size_t zdim;
+	char *dim;
+};
+/* the group of the main thread */
+static struct grp_s g0;
+/* number of worker threads */
+static size_t nthr = 1U;
+/* collect cast columns from the whole input */
+static int dscp;
 
 static size_t nlhs;
 static union {
@@ -86,6 +160,41 @@ static union {
 	size_t *p;
 } vhs;
 
+/* unsorted mode, i.e. LHS groups can be scattered across the input */
+static int unsp;
+/* output rows sorted by LHS in unsorted mode */
+static int srtp;
+/* memory budget for unsorted mode, in bytes */
+static size_t mmax = 1024U * 1024U * 1024U;
+/* index of LHS keys into rows */
+static struct htab_s rwx;
+/* row keys, key R spans [RWKO[R], RWKO[R + 1U]) */
+static struct arena_s rwk;
+static size_t *rwko;
+static size_t nrw;
+static size_t zrw;
+/* records, column-wise: row, cast column and end offset of the value
+ * in RCV, record I's value begins where record I - 1U's ends */
+static size_t *rcr;
+static size_t *rcc;
+static size_t *rco;
+static size_t nrc;
+static size_t zrc;
+static struct arena_s rcv;
+/* with --agg records are cells instead, one per row and cast column,
+ * whose values go straight into accumulators, NVA per cell in RCA,
+ * cells are indexed by row and cast column */
+static struct agg_s *rca;
+static struct htab_s rcx;
+/* order of rows, fixed once records have been written to runs */
+static size_t *rwp;
+/* runs of records of the current pass, lines of row, cast column and
+ * value, or count and accumulator per value field with --agg, each
+ * sorted by order of rows, older records in earlier runs */
+#define NRRN	(64U)
+static int rrn[NRRN];
+static size_t nrrn;
+
 
 static void
 __attribute__((format(printf, 1, 2)))
@@ -110,115 +219,534 @@ memchrnul(const char *s, int c, size_t z)
 	return memchr(s, c, z) ?: s + z;
 }
 
-/* murmur2 */
-#define HASHSIZE	(64U / 8U)
 
-static uint64_t
-MurmurHash64A(const void *key, size_t len, uint64_t seed)
+/* per-line kernels
+ * The formula shape is fixed once it's been snarfed, so rather than
+ * asking for the number of columns in each hand side on every line we
+ * pick specialised kernels once, see mkkn().  The hand sides' columns
+ * are kept as arrays, single columns point into the unions. */
+static const size_t *lcol;
+static size_t nlcol;
+static const size_t *rcol;
+static size_t nrcol;
+/* one based */
+static const size_t *vcol;
+static size_t nvcol;
+
+static inline uint64_t
+hashk(const char *ln, const size_t *of, const size_t *c, size_t nc)
 {
-	const uint64_t m = 0xc6a4a7935bd1e995ULL;
-	const int r = 47;
+/* hash fields C[0..NC) of LN */
+	uint64_t d = 0U;
 
-	uint64_t h = seed ^ (len * m);
+	for (size_t i = 0U; i < nc; i++) {
+		const size_t bo = of[c[i] + 0U];
+		const size_t eo = of[c[i] + 1U];
+		d = hashc(d, ln + bo, eo - bo - 1U);
+	}
+	return d;
+}
 
-	const uint64_t * data = (const uint64_t *)key;
-	const uint64_t * end = data + (len/8);
+static inline int
+keyeq(const char *k, size_t kz,
+      const char *ln, const size_t *of, const size_t *c, size_t nc)
+{
+/* check if fields C[0..NC) of LN, tab separated, spell K of size KZ */
+	size_t n = 0U;
 
-	while(data != end) {
-		uint64_t k = *data++;
+	for (size_t i = 0U; i < nc; i++) {
+		const size_t bo = of[c[i] + 0U];
+		const size_t eo = of[c[i] + 1U];
+		const size_t z = eo - bo - 1U;
+
+		if (n + z > kz || memcmp(k + n, ln + bo, z)) {
+			return 0;
+		} else if ((n += z) < kz && k[n] != '\t') {
+			return 0;
+		}
+		n++;
+	}
+	return n == kz + 1U;
+}
 
-		k *= m;
-		k ^= k >> r;
-		k *= m;
+static inline size_t
+keysz(const size_t *of, const size_t *c, size_t nc, size_t b)
+{
+/* length of fields C[0..NC) - B, tab separated */
+	size_t z = 0U;
 
-		h ^= k;
-		h *= m;
+	for (size_t i = 0U; i < nc; i++) {
+		const size_t bo = of[c[i] - b + 0U];
+		const size_t eo = of[c[i] - b + 1U];
+		z += eo - bo;
 	}
+	/* no separator after the last one */
+	return z - 1U;
+}
 
-	const unsigned char * data2 = (const unsigned char*)data;
+static inline void
+keycp(char *restrict tgt, const char *ln,
+      const size_t *of, const size_t *c, size_t nc, size_t b)
+{
+/* copy fields C[0..NC) - B of LN to TGT, tab separated */
+	for (size_t i = 0U, n = 0U; i < nc; i++) {
+		const size_t bo = of[c[i] - b + 0U];
+		const size_t eo = of[c[i] - b + 1U];
+
+		memcpy(tgt + n, ln + bo, eo - bo - 1U);
+		n += eo - bo - 1U;
+		if (i + 1U < nc) {
+			tgt[n++] = '\t';
+		}
+	}
+	return;
+}
 
-	switch(len & 7) {
-	case 7: h ^= (uint64_t)(data2[6]) << 48;
-	case 6: h ^= (uint64_t)(data2[5]) << 40;
-	case 5: h ^= (uint64_t)(data2[4]) << 32;
-	case 4: h ^= (uint64_t)(data2[3]) << 24;
-	case 3: h ^= (uint64_t)(data2[2]) << 16;
-	case 2: h ^= (uint64_t)(data2[1]) << 8;
-	case 1: h ^= (uint64_t)(data2[0]);
-		h *= m;
-		break;
-	};
+/* hashing and comparing kernels for hand side S in variant Z */
+#define KH(S, Z, N)							\
+static uint64_t								\
+khash##S##Z(const char *ln, const size_t *of)				\
+{									\
+	return hashk(ln, of, S##col, N);				\
+}									\
+									\
+static int								\
+kkeq##S##Z(const char *k, size_t kz, const char *ln, const size_t *of)	\
+{									\
+	return keyeq(k, kz, ln, of, S##col, N);				\
+}
 
-	h ^= h >> r;
-	h *= m;
-	h ^= h >> r;
+/* sizing and copying kernels for hand side S in variant Z */
+#define KC(S, Z, N, B)							\
+static size_t								\
+ksz##S##Z(const size_t *of)						\
+{									\
+	return keysz(of, S##col, N, B);					\
+}									\
+									\
+static void								\
+kcp##S##Z(char *restrict tgt, const char *ln, const size_t *of)		\
+{									\
+	keycp(tgt, ln, of, S##col, N, B);				\
+}
 
-	return h;
-} 
+KH(l, 1, 1U)
+KH(l, 2, 2U)
+KH(l, n, nlcol)
+KC(l, 1, 1U, 0U)
+KC(l, 2, 2U, 0U)
+KC(l, n, nlcol, 0U)
+KH(r, 1, 1U)
+KH(r, 2, 2U)
+KH(r, n, nrcol)
+KC(v, 1, 1U, 1U)
+KC(v, 2, 2U, 1U)
+KC(v, n, nvcol, 1U)
+
+/* no LHS at all, everything is one group, dimension `.' */
+static uint64_t
+khashl0(const char *UNUSED(ln), const size_t *UNUSED(of))
+{
+	return ~0ULL;
+}
 
-#define hash(x, y)	MurmurHash64A((x), (y), 0UL)
-#define hash2(x, y, z)	MurmurHash64A((x), (y), (z))
+static int
+kkeql0(const char *UNUSED(k), size_t UNUSED(kz),
+      const char *UNUSED(ln), const size_t *UNUSED(of))
+{
+	return 1;
+}
+
+static size_t
+kszl0(const size_t *UNUSED(of))
+{
+	return 1U;
+}
 
-
-/* ccv operations */
 static void
-prnt(void)
+kcpl0(char *restrict tgt, const char *UNUSED(ln), const size_t *UNUSED(of))
 {
-	size_t m[ncc];
-	size_t s[ncc];
-	size_t ns = 0U;
+	*tgt = '.';
+	return;
+}
 
-	if (UNLIKELY(!ndim)) {
-		/* no dimensions? */
-		return;
+static struct {
+	uint64_t(*hashl)(const char *ln, const size_t *of);
+	int(*keql)(const char *k, size_t kz, const char *ln, const size_t *of);
+	size_t(*szl)(const size_t *of);
+	void(*cpl)(char *restrict tgt, const char *ln, const size_t *of);
+	uint64_t(*hashr)(const char *ln, const size_t *of);
+	int(*keqr)(const char *k, size_t kz, const char *ln, const size_t *of);
+	size_t(*szv)(const size_t *of);
+	void(*cpv)(char *restrict tgt, const char *ln, const size_t *of);
+} kn;
+
+#define KNL(Z)	\
+	(kn.hashl = khashl##Z, kn.keql = kkeql##Z,			\
+	 kn.szl = kszl##Z, kn.cpl = kcpl##Z)
+#define KNR(Z)	(kn.hashr = khashr##Z, kn.keqr = kkeqr##Z)
+#define KNV(Z)	(kn.szv = kszv##Z, kn.cpv = kcpv##Z)
+
+static void
+mkkn(void)
+{
+/* choose kernels by formula shape */
+	lcol = nlhs ? lhs.p : &lhs.v;
+	nlcol = nlhs ?: (lhs.v + 1U ? 1U : 0U);
+	rcol = nrhs ? rhs.p : &rhs.v;
+	nrcol = nrhs ?: (rhs.v + 1U ? 1U : 0U);
+	vcol = nvhs ? vhs.p : &vhs.v;
+	nvcol = nvhs ?: 1U;
+
+	switch (nlcol) {
+	case 0U:
+		KNL(0);
+		break;
+	case 1U:
+		KNL(1);
+		break;
+	case 2U:
+		KNL(2);
+		break;
+	default:
+		KNL(n);
+		break;
 	}
-	if (!(rhs.v + 1U)) {
-		/* just the dimension */
-		goto more;
+	switch (nrcol) {
+	case 1U:
+		KNR(1);
+		break;
+	case 2U:
+		KNR(2);
+		break;
+	default:
+		KNR(n);
+		break;
+	}
+	switch (nvcol) {
+	case 1U:
+		KNV(1);
+		break;
+	case 2U:
+		KNV(2);
+		break;
+	default:
+		KNV(n);
+		break;
+	}
+	return;
+}
+
+
+
+/* cell operations */
+static inline size_t
+ccpos(size_t j)
+{
+/* output position of cast column J */
+	return ccr != NULL ? ccr[j] : j;
+}
+
+static inline size_t
+ccat(size_t i)
+{
+/* cast column at output position I */
+	return ccp != NULL ? ccp[i] : i;
+}
+
+static size_t
+bang0(struct grp_s *restrict g, size_t j, size_t len)
+{
+/* make room for another value of size LEN in cast column J,
+ * return its offset into G's values or ARENA_NIL */
+	const size_t o = arena_alloc(&g->val, len);
+	const size_t c = arena_alloc(&g->cel, sizeof(struct cel_s));
+
+	if (UNLIKELY(o == ARENA_NIL || c == ARENA_NIL)) {
+		return ARENA_NIL;
+	}
+	*(struct cel_s*)arena_ptr(&g->cel, c) = (struct cel_s){j, o, len};
+	return o;
+}
+
+static struct agg_s*
+agcl(struct grp_s *restrict g, size_t j)
+{
+/* accumulators of cast column J, cleared upon first use in a group */
+	const size_t nva = nvhs ?: 1U;
+	struct agg_s *a = g->cca + j * nva;
+
+	if (g->cag[j] != g->agn) {
+		memset(a, 0, nva * sizeof(*a));
+		g->cag[j] = g->agn;
+	}
+	return a;
+}
+
+static ssize_t
+gath(struct grp_s *restrict g)
+{
+/* gather the cells of G by cast column, counting sort style,
+ * return the number of non-empty cast columns */
+	const struct cel_s *c = arena_ptr(&g->cel, 0U);
+	const size_t nc = g->cel.n / sizeof(*c);
+	size_t nne = 0U;
+
+	if (UNLIKELY(nc > g->zgc)) {
+		while ((g->zgc = (g->zgc * 2U) ?: 64U) < nc);
+		g->gc = realloc(g->gc, g->zgc * sizeof(*g->gc));
+		g->ne = realloc(g->ne, g->zgc * sizeof(*g->ne));
+		g->nm = realloc(g->nm, g->zgc * sizeof(*g->nm));
+	}
+	if (UNLIKELY(ncc + 2U > g->zgo)) {
+		while ((g->zgo = (g->zgo * 2U) ?: 64U) < ncc + 2U);
+		g->go = realloc(g->go, g->zgo * sizeof(*g->go));
+	}
+	if (UNLIKELY(g->gc == NULL || g->ne == NULL || g->nm == NULL)) {
+		g->zgc = 0U;
+		return -1;
+	} else if (UNLIKELY(g->go == NULL)) {
+		g->zgo = 0U;
+		return -1;
+	}
+	/* count into GO[J + 2U] so that after the prefix sum GO[J + 1U]
+	 * is where column J starts, and after scattering where it ends,
+	 * J being the output position of the cast column */
+	memset(g->go, 0, (ncc + 2U) * sizeof(*g->go));
+	for (size_t i = 0U; i < nc; i++) {
+		g->go[ccpos(c[i].j) + 2U]++;
+	}
+	for (size_t j = 2U; j < ncc + 2U; j++) {
+		g->go[j] += g->go[j - 1U];
+	}
+	for (size_t i = 0U; i < nc; i++) {
+		g->gc[g->go[ccpos(c[i].j) + 1U]++] = c[i];
+	}
+	for (size_t j = 0U; j < ncc; j++) {
+		if (g->go[j + 1U] > g->go[j]) {
+			g->nm[nne] = 0U;
+			g->ne[nne++] = j;
+		}
+	}
+	return nne;
+}
+
+static int
+mktl(struct grp_s *restrict g)
+{
+/* set up the row template for NCC cast columns */
+	const size_t nf = ncc * (nvhs ?: 1U);
+	char *tl;
+
+	if (UNLIKELY((tl = realloc(g->tl, nf + 1U)) == NULL)) {
+		return -1;
 	}
-	memset(m, 0, sizeof(m));
+	memset(tl, '\t', nf);
+	tl[nf] = '\n';
+	g->tl = tl;
+	g->ntl = nf + 1U;
+	return 0;
+}
+
+static int
+agmt(struct grp_s *restrict g)
+{
+/* turn accumulators into values */
+	const size_t nva = nvhs ?: 1U;
+
 	for (size_t j = 0U; j < ncc; j++) {
-		if (nccv[j]) {
-			/* at least one value */
-			goto prnt;
+		const struct agg_s *a = g->cca + j * nva;
+		char buf[nva * 32U];
+		size_t n = 0U;
+		size_t o;
+
+		if (g->cag[j] != g->agn) {
+			continue;
+		}
+		for (size_t i = 0U; i < nva; i++) {
+			if (aggf == AGG_COUNT) {
+				n += snprintf(buf + n, 32U, "%zu", a[i].n);
+			} else if (a[i].n) {
+				const double x = aggf == AGG_MEAN
+					? a[i].x / (double)a[i].n : a[i].x;
+				n += snprintf(buf + n, 32U,
+					      binp ? "%.17g" : "%.15g", x);
+			}
+			if (i + 1U < nva) {
+				buf[n++] = '\t';
+			}
+		}
+		if (UNLIKELY((o = bang0(g, j, n)) == ARENA_NIL)) {
+			return -1;
+		}
+		memcpy(arena_ptr(&g->val, o), buf, n);
+	}
+	return 0;
+}
+
+static void
+pval(obuf_t o, const char *v, size_t z)
+{
+/* output value V of size Z, fields tab separated, as per VTYP */
+	for (const typ_t *t = vtyp;; t++) {
+		const char *const p = memchrnul(v, '\t', z);
+
+		if (*t == TYP_STR) {
+			obuf_add(o, v, p - v);
+		} else {
+			char buf[TYP_FMTZ];
+			typv_t x;
+
+			(void)typ_parse(&x, *t, v, p - v);
+			obuf_add(o, buf, typ_fmt(buf, *t, x));
+		}
+		if (p >= v + z) {
+			break;
+		}
+		obuf_chr(o, '\t');
+		z -= p + 1U - v;
+		v = p + 1U;
+	}
+	return;
+}
+
+static void
+bval(bcol_t b, size_t i, const char *v, size_t z)
+{
+/* add value V of size Z, fields tab separated, to columns I onwards */
+	for (;; i++) {
+		const char *const p = memchrnul(v, '\t', z);
+
+		bcol_add(b, i, v, p - v);
+		if (p >= v + z) {
+			break;
+		}
+		z -= p + 1U - v;
+		v = p + 1U;
+	}
+	return;
+}
+
+static void
+brow(struct grp_s *restrict g, obuf_t o, size_t nne)
+{
+/* add the current row of G to its binary block */
+	const size_t nva = nvhs ?: 1U;
+	const size_t nlb = nbc - ncc * nva;
+	size_t k = 0U;
+
+	/* dimension line */
+	bval(g->bc, 0U, g->dim, g->ndim);
+	for (size_t i = 0U; i < nne; i++) {
+		const size_t j = g->ne[i];
+		const struct cel_s *c = g->gc + g->go[j] + g->nm[i];
+
+		/* empty cells up to cast column J */
+		for (; k < j * nva; k++) {
+			bcol_add(g->bc, nlb + k, "", 0U);
 		}
+		bval(g->bc, nlb + k, arena_ptr(&g->val, c->o), c->z);
+		k += nva;
+	}
+	for (; k < ncc * nva; k++) {
+		bcol_add(g->bc, nlb + k, "", 0U);
+	}
+	if (bcol_row(g->bc)) {
+		bcol_flush(g->bc, o);
+	}
+	return;
+}
+
+static void
+bfls(struct grp_s *restrict g, obuf_t o)
+{
+/* write out the binary block of G */
+	if (g->bc != NULL) {
+		bcol_flush(g->bc, o);
 	}
 	return;
+}
 
-prnt:
-	/* determine order of stepping */
-	memset(s, 0, sizeof(s));
-	for (size_t j = ncc; j > 0U; j--) {
-		if (nccv[j - 1U] > 1U) {
-			s[ns++] = j - 1U;
+static int
+prnt(struct grp_s *restrict g, obuf_t o)
+{
+	const size_t nva = nvhs ?: 1U;
+	size_t nne = 0U;
+
+	if (UNLIKELY(!g->ndim)) {
+		/* no dimensions? */
+		return 0;
+	}
+	if (aggf && UNLIKELY(agmt(g) < 0)) {
+		error("\
+Error: cannot allocate memory to hold aggregates");
+		return -1;
+	}
+	if (UNLIKELY(g->ntl != ncc * nva + 1U) && UNLIKELY(mktl(g) < 0)) {
+		error("\
+Error: cannot set up row template");
+		return -1;
+	} else if (binp && UNLIKELY(g->bc == NULL) &&
+		   UNLIKELY((g->bc = bcol_open(nbc, btyp)) == NULL)) {
+		error("\
+Error: cannot set up binary output");
+		return -1;
+	}
+	if (!(rhs.v + 1U)) {
+		/* just the dimension */
+		;
+	} else if (!g->cel.n) {
+		/* not a single value */
+		return 0;
+	} else with (ssize_t r = gath(g)) {
+		if (UNLIKELY(r < 0)) {
+			error("\
+Error: cannot gather cells of group");
+			return -1;
 		}
+		nne = r;
 	}
+
 more:
+	if (binp) {
+		brow(g, o, nne);
+		goto next;
+	}
 	/* dimension line */
-	fwrite(dim, sizeof(*dim), ndim, stdout);
-	for (size_t j = 0U; j < ncc; j++) {
-		fputc('\t', stdout);
-		if (nccv[j]) {
-			fwrite(ccv[j] + ccvo[j][m[j]], sizeof(char),
-			       ccvo[j][m[j] + 1U] - ccvo[j][m[j]], stdout);
-		}
-	}
-	if (ns) {
-		/* multi-step */
-		for (size_t i = 0U; i < ns; i++) {
-			if (++m[s[i]] < nccv[s[i]]) {
-				fputc('\n', stdout);
-				goto more;
+	obuf_add(o, g->dim, g->ndim);
+	with (size_t k = 0U) {
+		for (size_t i = 0U; i < nne; i++) {
+			const size_t j = g->ne[i];
+			const struct cel_s *c = g->gc + g->go[j] + g->nm[i];
+
+			/* separators up to and including cast column J,
+			 * the cell itself brings those between its fields */
+			obuf_add(o, g->tl, j * nva + 1U - k);
+			if (vtyp == NULL) {
+				obuf_add(o, arena_ptr(&g->val, c->o), c->z);
+			} else {
+				pval(o, arena_ptr(&g->val, c->o), c->z);
 			}
-			m[s[i]] = 0U;
+			k = (j + 1U) * nva;
 		}
+		/* the rest of the template, empty cells and newline */
+		obuf_add(o, g->tl + k, g->ntl - k);
 	}
-	fputc('\n', stdout);
-	return;
+next:
+	/* multi-step, rightmost cast column fastest */
+	for (size_t i = nne; i-- > 0U;) {
+		const size_t j = g->ne[i];
+
+		if (++g->nm[i] < g->go[j + 1U] - g->go[j]) {
+			goto more;
+		}
+		g->nm[i] = 0U;
+	}
+	return 0;
 }
 
 static void
-phdr(const char *hdrs, const size_t *hoff)
+thdr(obuf_t o, const char *hdrs, const size_t *hoff)
 {
 	if (hdrs == NULL) {
 		size_t i;
@@ -231,10 +759,10 @@ phdr(const char *hdrs, const size_t *hoff)
 		while (j < nlhs) {
 			i = lhs.p[j];
 		one:
-			fputc('V', stdout);
-			fprintf(stdout, "%zu", i + 1U);
+			obuf_chr(o, 'V');
+			obuf_fmt(o, "%zu", i + 1U);
 			if (++j < nlhs) {
-				fputc('\t', stdout);
+				obuf_chr(o, '\t');
 			}
 		}
 	} else {
@@ -250,25 +778,25 @@ phdr(const char *hdrs, const size_t *hoff)
 		onh:;
 			const size_t of = hoff[i + 0U];
 			const size_t eo = hoff[i + 1U];
-			fwrite(hdrs + of, sizeof(*hdrs), eo - of - 1U, stdout);
+			obuf_add(o, hdrs + of, eo - of - 1U);
 			if (++j < nlhs) {
-				fputc('\t', stdout);
+				obuf_chr(o, '\t');
 			}
 		}
 	}
 	if (!nvhs) {
 		for (size_t i = 0U; i < ncc; i++) {
-			fputc('\t', stdout);
-			fputs(cn[i], stdout);
+			obuf_chr(o, '\t');
+			obuf_str(o, cn[ccat(i)]);
 		}
 	} else if (hdrs == NULL) {
 		for (size_t i = 0U; i < ncc; i++) {
 			for (size_t j = 0U; j < nvhs; j++) {
-				fputc('\t', stdout);
-				fputs(cn[i], stdout);
-				fputc('*', stdout);
-				fputc('V', stdout);
-				fprintf(stdout, "%zu", vhs.p[j]);
+				obuf_chr(o, '\t');
+				obuf_str(o, cn[ccat(i)]);
+				obuf_chr(o, '*');
+				obuf_chr(o, 'V');
+				obuf_fmt(o, "%zu", vhs.p[j]);
 			}
 		}
 	} else for (size_t i = 0U; i < ncc; i++) {
@@ -276,200 +804,408 @@ phdr(const char *hdrs, const size_t *hoff)
 			const size_t of = hoff[vhs.p[j] - 1U];
 			const size_t eo = hoff[vhs.p[j] - 0U];
 
-			fputc('\t', stdout);
-			fputs(cn[i], stdout);
-			fputc('*', stdout);
-			fwrite(hdrs + of, sizeof(*hdrs), eo - of - 1U, stdout);
+			obuf_chr(o, '\t');
+			obuf_str(o, cn[ccat(i)]);
+			obuf_chr(o, '*');
+			obuf_add(o, hdrs + of, eo - of - 1U);
 		}
 	}
-	fputc('\n', stdout);
+	obuf_chr(o, '\n');
 	return;
 }
 
-static void
-rset(const char *line, const size_t *coff)
+static int
+bhdr(const char *hdrs, const size_t *hoff)
 {
-	memset(nccv, 0, ncc * sizeof(*nccv));
+/* print the header of the binary stream, column names as per thdr() */
+	const size_t nva = nvhs ?: 1U;
+	const size_t nlb = nlcol ?: 1U;
+	const char *h, *eh;
+	obuf_t o;
+	size_t z;
+
+	nbc = nlb + ncc * nva;
+	if (UNLIKELY((btyp = malloc(nbc * sizeof(*btyp))) == NULL)) {
+		return -1;
+	} else if (UNLIKELY((o = obuf_open(-1)) == NULL)) {
+		return -1;
+	}
+	for (size_t i = 0U; i < nlb; i++) {
+		btyp[i] = TYP_STR;
+	}
+	for (size_t i = nlb; i < nbc; i++) {
+		btyp[i] = vtyp ? vtyp[(i - nlb) % nva] : TYP_STR;
+	}
+	thdr(o, hdrs, hoff);
+	h = obuf_data(o, &z);
+	eh = h + z - 1U;
+	bcol_hdr(ob, nbc);
+	for (size_t i = 0U; i < nbc; i++) {
+		const char *p = memchrnul(h, '\t', eh - h);
 
-	for (size_t j = 0U; j < ncc; j++) {
-		ccvo[j][0U] = 0U;
-		ccvo[j][1U] = 0U;
+		bcol_name(ob, btyp[i], h, p - h);
+		h = p + (p < eh);
 	}
+	return obuf_close(o);
+}
 
-	/* make up dimension line */
-	if (!nlhs && lhs.v + 1U) {
-		const size_t of = coff[lhs.v + 0U];
-		const size_t eo = coff[lhs.v + 1U];
-		if (UNLIKELY(eo - of >= zdim)) {
-			while ((zdim = (zdim * 2U) ?: 64U) < eo - of);
-			dim = realloc(dim, zdim * sizeof(*dim));
-		}
-		memcpy(dim, line + of, ndim = eo - of);
-	} else if (!nlhs) {
-		if (UNLIKELY(!zdim)) {
-			dim = malloc(8U);
-		}
-		ndim = 0U;
-		dim[ndim++] = '.';
-		ndim++;
-	} else for (size_t i = 0U, n = 0U; i < nlhs; i++, ndim = n) {
-		const size_t of = coff[lhs.p[i] + 0U];
-		const size_t eo = coff[lhs.p[i] + 1U];
-		if (UNLIKELY(n + eo - of >= zdim)) {
-			while ((zdim = (zdim * 2U) ?: 64U) < n + eo - of);
-			dim = realloc(dim, zdim * sizeof(*dim));
-		}
-		memcpy(dim + n, line + of, eo - of - 1U);
-		n += eo - of - 1U;
-		dim[n++] = '\t';
-	}
-	/* omit trailing separator */
-	ndim--;
+static void
+phdr(const char *hdrs, const size_t *hoff)
+{
+	if (!binp) {
+		thdr(ob, hdrs, hoff);
+	} else if (UNLIKELY(bhdr(hdrs, hoff) < 0)) {
+		error("\
+Error: cannot print header of binary output");
+	}
 	return;
 }
 
 static void
-bang(const char *line, const size_t *coff, size_t j)
+rclr(struct grp_s *restrict g)
 {
-	size_t len;
-	size_t nj;
+	arena_reset(&g->cel);
+	arena_reset(&g->val);
+	/* invalidate all accumulators */
+	g->agn++;
+	return;
+}
 
-	/* determine length */
-	if (!nvhs) {
-		const size_t bo = coff[vhs.v - 1U];
-		const size_t eo = coff[vhs.v - 0U];
-		len = eo - bo - 1U;
-	} else for (size_t i = len = 0U; i < nvhs; i++) {
-		const size_t bo = coff[vhs.p[i] - 1U];
-		const size_t eo = coff[vhs.p[i] - 0U];
-		len += eo - bo;
-	}
+static void
+mkdim(struct grp_s *restrict g, const char *line, const size_t *coff)
+{
+	/* make up dimension line */
+	const size_t z = kn.szl(coff);
 
-	if (UNLIKELY((nj = ccvo[j][nccv[j]]) + len >= zccv[j])) {
-		/* resize */
-		while ((zccv[j] = (zccv[j] * 2U) ?: 64U) < nj + len);
-		ccv[j] = realloc(ccv[j], zccv[j] * sizeof(*ccv[j]));
+	if (UNLIKELY(z >= g->zdim)) {
+		while ((g->zdim = (g->zdim * 2U) ?: 64U) <= z);
+		g->dim = realloc(g->dim, g->zdim * sizeof(*g->dim));
 	}
+	kn.cpl(g->dim, line, coff);
+	g->ndim = z;
+	return;
+}
 
-	if (!nvhs) {
-		const size_t bo = coff[vhs.v - 1U];
-		memcpy(ccv[j] + nj, line + bo, len);
-		nj += len;
-	} else for (size_t i = 0U; i < nvhs; i++) {
-		const size_t bo = coff[vhs.p[i] - 1U];
-		const size_t eo = coff[vhs.p[i] - 0U];
-		memcpy(ccv[j] + nj, line + bo, eo - bo - 1U);
-		ccv[j][nj += eo - bo - 1U] = '\t';
-		nj += i + 1U < nvhs;
-	}
-
-	if (UNLIKELY(++nccv[j] >= zccvo[j])) {
-		zccvo[j] *= 2U;
-		ccvo[j] = realloc(ccvo[j], zccvo[j] * sizeof(*ccvo[j]));
-	}
-	/* store current end */
-	ccvo[j][nccv[j]] = nj;
+static void
+rset(struct grp_s *restrict g, const char *line, const size_t *coff)
+{
+	rclr(g);
+	mkdim(g, line, coff);
 	return;
 }
 
 static void
-mtcc(void)
+dset(struct grp_s *restrict g, const char *k, size_t z)
 {
-	for (size_t i = ncc; i < zcc; i++) {
-		free(ccvo[i]);
+/* use K of size Z as dimension line */
+	if (UNLIKELY(z >= g->zdim)) {
+		while ((g->zdim = (g->zdim * 2U) ?: 64U) <= z);
+		g->dim = realloc(g->dim, g->zdim * sizeof(*g->dim));
 	}
-	zcc = 0U;
+	memcpy(g->dim, k, g->ndim = z);
 	return;
 }
 
-static int
-stcc(char *const *args, size_t nargs)
+static void
+agg1(struct agg_s *restrict a, const char *s, size_t z)
 {
-	if (!(ncc = nargs)) {
-		;
-	} else if (UNLIKELY((cc = calloc(ncc, sizeof(*cc))) == NULL)) {
-		return -1;
-	} else if (cnmp && UNLIKELY((cn = calloc(ncc, sizeof(*cn))) == NULL)) {
-		return -1;
-	} else if (UNLIKELY((nccv = calloc(ncc, sizeof(*nccv))) == NULL)) {
-		return -1;
-	} else if (UNLIKELY((ccv = calloc(ncc, sizeof(*ccv))) == NULL)) {
-		return -1;
-	} else if (UNLIKELY((ccvo = calloc(ncc, sizeof(*ccvo))) == NULL)) {
-		return -1;
-	} else if (UNLIKELY((zccv = calloc(ncc, sizeof(*zccv))) == NULL)) {
-		return -1;
-	} else if (UNLIKELY((zccvo = calloc(ncc, sizeof(*zccvo))) == NULL)) {
-		return -1;
-	}
-	for (size_t j = 0U; j < ncc; j++) {
-		ccvo[j] = calloc(8U, sizeof(*ccvo[j]));
-		zccvo[j] = 8U;
-	}
-	for (size_t i = 0U; i < ncc; i++) {
-		const char *c = args[i];
-		const char *const e = c + strlen(c);;
-		size_t j = 0U;
+	double x;
 
-		for (const char *p; c < e; c = p + 1U) {
-			p = memchrnul(c, '*', e - c);
-			cc[i] ^= hash2(c, p - c, j++);
-		}
-	}
-	if (!cnmp) {
-		return 0;
+	if (aggf == AGG_COUNT) {
+		a->n++;
+		return;
+	} else if (UNLIKELY(typ_dbl(&x, s, z) < 0)) {
+		/* not a number, ignore him */
+		return;
 	}
-	/* otherwise also store column names */
-	for (size_t i = 0U; i < ncc; i++) {
-		cn[i] = args[i];
+	switch (aggf) {
+	case AGG_SUM:
+	case AGG_MEAN:
+		a->x += x;
+		break;
+	case AGG_MIN:
+		if (!a->n || x < a->x) {
+			a->x = x;
+		}
+		break;
+	case AGG_MAX:
+		if (!a->n || x > a->x) {
+			a->x = x;
+		}
+		break;
+	case AGG_FIRST:
+		if (!a->n) {
+			a->x = x;
+		}
+		break;
+	case AGG_LAST:
+		a->x = x;
+		break;
+	default:
+		break;
 	}
-	return 0;
+	a->n++;
+	return;
 }
 
-static ssize_t
-adcc(const char *ln, const size_t *of, uint64_t c)
+static void
+agg2(struct agg_s *restrict a, const struct agg_s *b)
 {
-	if (UNLIKELY(ncc >= zcc)) {
-		const size_t nuz = (zcc * 2U) ?: 64U;
-
-		cc = realloc(cc, nuz * sizeof(*cc));
-		nccv = realloc(nccv, nuz * sizeof(*nccv));
-		ccv = realloc(ccv, nuz * sizeof(*ccv));
-		ccvo = realloc(ccvo, nuz * sizeof(*ccvo));
-		zccv = realloc(zccv, nuz * sizeof(*zccv));
-		zccvo = realloc(zccvo, nuz * sizeof(*zccvo));
-		if (cnmp) {
-			cn = realloc(cn, nuz * sizeof(*cn));
+/* fold accumulator B, of values after A's, into A */
+	if (!b->n) {
+		return;
+	}
+	switch (aggf) {
+	case AGG_SUM:
+	case AGG_MEAN:
+		a->x += b->x;
+		break;
+	case AGG_MIN:
+		if (!a->n || b->x < a->x) {
+			a->x = b->x;
+		}
+		break;
+	case AGG_MAX:
+		if (!a->n || b->x > a->x) {
+			a->x = b->x;
+		}
+		break;
+	case AGG_FIRST:
+		if (!a->n) {
+			a->x = b->x;
 		}
+		break;
+	case AGG_LAST:
+		a->x = b->x;
+		break;
+	default:
+		break;
+	}
+	a->n += b->n;
+	return;
+}
 
-		if (UNLIKELY(cc == NULL)) {
+static void
+aggv(struct grp_s *restrict g,
+     const char *line, const size_t *coff, size_t j)
+{
+	struct agg_s *a = agcl(g, j);
+
+	for (size_t i = 0U; i < nvcol; i++) {
+		const size_t bo = coff[vcol[i] - 1U];
+		const size_t eo = coff[vcol[i] - 0U];
+		agg1(a + i, line + bo, eo - bo - 1U);
+	}
+	return;
+}
+
+static int
+bang(struct grp_s *restrict g,
+     const char *line, const size_t *coff, size_t j)
+{
+	size_t o;
+
+	if (aggf) {
+		aggv(g, line, coff, j);
+		return 0;
+	} else if (UNLIKELY((o = bang0(g, j, kn.szv(coff))) == ARENA_NIL)) {
+		return -1;
+	}
+	kn.cpv(arena_ptr(&g->val, o), line, coff);
+	return 0;
+}
+
+static int
+cccmp(const void *x, const void *y)
+{
+	const size_t i = *(const size_t*)x;
+	const size_t j = *(const size_t*)y;
+	const size_t iz = cko[i + 1U] - cko[i];
+	const size_t jz = cko[j + 1U] - cko[j];
+	const int c = memcmp(arena_ptr(&cka, cko[i]), arena_ptr(&cka, cko[j]),
+			     iz < jz ? iz : jz);
+
+	return c ?: (iz > jz) - (iz < jz);
+}
+
+static int
+srcc(void)
+{
+/* sort cast columns by key, for output purposes only */
+	if (!ncc) {
+		return 0;
+	} else if (UNLIKELY((ccp = realloc(ccp, ncc * sizeof(*ccp))) == NULL)) {
+		return -1;
+	} else if (UNLIKELY((ccr = realloc(ccr, ncc * sizeof(*ccr))) == NULL)) {
+		return -1;
+	}
+	for (size_t i = 0U; i < ncc; i++) {
+		ccp[i] = i;
+	}
+	qsort(ccp, ncc, sizeof(*ccp), cccmp);
+	for (size_t i = 0U; i < ncc; i++) {
+		ccr[ccp[i]] = i;
+	}
+	return 0;
+}
+
+static int
+mtcc(void)
+{
+/* materialise cast columns, no more are to be added */
+	zcc = 0U;
+	if (scap) {
+		return srcc();
+	}
+	return 0;
+}
+
+static int
+mkgrp(struct grp_s *restrict g, size_t n)
+{
+/* set up group G for N cast columns */
+	if (!n || !aggf) {
+		/* cells live in arenas, nothing per cast column */
+		return 0;
+	} else if (UNLIKELY((g->cca = calloc(n * (nvhs ?: 1U),
+					     sizeof(*g->cca))) == NULL)) {
+		return -1;
+	} else if (UNLIKELY((g->cag = calloc(n, sizeof(*g->cag))) == NULL)) {
+		return -1;
+	}
+	return 0;
+}
+
+static void
+frgrp(struct grp_s *restrict g)
+{
+/* free group G */
+	arena_fini(&g->cel);
+	arena_fini(&g->val);
+	free(g->gc);
+	free(g->go);
+	free(g->ne);
+	free(g->nm);
+	free(g->tl);
+	free(g->cca);
+	free(g->cag);
+	free(g->dim);
+	if (g->bc != NULL) {
+		bcol_close(g->bc);
+	}
+	return;
+}
+
+static int
+stcc(char *const *args, size_t nargs)
+{
+	if (!(ncc = nargs)) {
+		;
+	} else if (UNLIKELY((cc = calloc(ncc, sizeof(*cc))) == NULL)) {
+		return -1;
+	} else if (cnmp && UNLIKELY((cn = calloc(ncc, sizeof(*cn))) == NULL)) {
+		return -1;
+	} else if (UNLIKELY((cko = calloc(ncc + 1U, sizeof(*cko))) == NULL)) {
+		return -1;
+	} else if (UNLIKELY(mkgrp(&g0, ncc) < 0)) {
+		return -1;
+	}
+	for (size_t i = 0U; i < ncc; i++) {
+		const char *c = args[i];
+		const char *const e = c + strlen(c);
+
+		size_t o;
+
+		for (const char *p; c < e; c = p + 1U) {
+			p = memchrnul(c, '*', e - c);
+			cc[i] = hashc(cc[i], c, p - c);
+		}
+		if (UNLIKELY(htab_put(&ccx, cc[i], i) < 0)) {
 			return -1;
-		} else if (UNLIKELY(nccv == NULL)) {
+		}
+		/* keep the key, with tabs instead of stars */
+		if (UNLIKELY((o = arena_add(&cka, args[i], e - args[i])) ==
+			     ARENA_NIL)) {
 			return -1;
-		} else if (UNLIKELY(ccv == NULL)) {
+		}
+		with (char *k = arena_ptr(&cka, o)) {
+			const char *const ek = k + (e - args[i]);
+
+			for (; (k = memchr(k, '*', ek - k)); *k++ = '\t');
+		}
+		cko[i + 1U] = cka.n;
+	}
+	if (!cnmp) {
+		return 0;
+	}
+	/* otherwise also store column names */
+	for (size_t i = 0U; i < ncc; i++) {
+		cn[i] = args[i];
+	}
+	return 0;
+}
+
+static ssize_t
+adcc(const char *ln, const size_t *of, uint64_t c)
+{
+	if (UNLIKELY(ncc >= zcc)) {
+		const size_t nuz = (zcc * 2U) ?: 64U;
+
+		cc = realloc(cc, nuz * sizeof(*cc));
+		cko = realloc(cko, (nuz + 1U) * sizeof(*cko));
+		if (cnmp) {
+			cn = realloc(cn, nuz * sizeof(*cn));
+		}
+		if (aggf) {
+			const size_t nva = nvhs ?: 1U;
+			g0.cca = realloc(g0.cca, nuz * nva * sizeof(*g0.cca));
+			g0.cag = realloc(g0.cag, nuz * sizeof(*g0.cag));
+		}
+
+		if (UNLIKELY(cc == NULL)) {
 			return -1;
-		} else if (UNLIKELY(ccvo == NULL)) {
+		} else if (UNLIKELY(cko == NULL)) {
 			return -1;
-		} else if (UNLIKELY(zccv == NULL)) {
+		} else if (cnmp && UNLIKELY(cn == NULL)) {
 			return -1;
-		} else if (UNLIKELY(zccvo == NULL)) {
+		} else if (aggf && UNLIKELY(g0.cca == NULL)) {
 			return -1;
-		} else if (cnmp && UNLIKELY(cn == NULL)) {
+		} else if (aggf && UNLIKELY(g0.cag == NULL)) {
 			return -1;
 		}
 		memset(cc + zcc, 0, (nuz - zcc) * sizeof(*cc));
-		memset(nccv + zcc, 0, (nuz - zcc) * sizeof(*nccv));
-		memset(ccv + zcc, 0, (nuz - zcc) * sizeof(*ccv));
-		memset(zccv + zcc, 0, (nuz - zcc) * sizeof(*zccv));
-		for (size_t j = zcc; j < nuz; j++) {
-			ccvo[j] = calloc(8U, sizeof(*ccvo[j]));
-			zccvo[j] = 8U;
+		if (aggf) {
+			/* accumulators are cleared when first used */
+			memset(g0.cag + zcc, 0,
+			       (nuz - zcc) * sizeof(*g0.cag));
 		}
 
 		zcc = nuz;
 	}
 	/* really add him now */
 	cc[ncc] = c;
+	if (UNLIKELY(htab_put(&ccx, c, ncc) < 0)) {
+		return -1;
+	}
+	/* and keep his key for verification */
+	cko[ncc] = cka.n;
+	if (!nrhs) {
+		const size_t bo = of[rhs.v + 0U];
+		const size_t eo = of[rhs.v + 1U];
+		const size_t z = eo - bo - 1U;
+		if (UNLIKELY(arena_add(&cka, ln + bo, z) == ARENA_NIL)) {
+			return -1;
+		}
+	} else for (size_t j = 0U; j < nrhs; j++) {
+		const size_t bo = of[rhs.p[j] + 0U];
+		const size_t eo = of[rhs.p[j] + 1U];
+		/* include the separator, except for the last field */
+		const size_t z = eo - bo - (j + 1U >= nrhs);
+		if (UNLIKELY(arena_add(&cka, ln + bo, z) == ARENA_NIL)) {
+			return -1;
+		}
+	}
+	cko[ncc + 1U] = cka.n;
 	if (cnmp) {
 		/* otherwise also remember his name */
 		size_t z = 0U;
@@ -563,74 +1299,112 @@ chck(size_t ncol)
 	if (UNLIKELY(!nvhs && !vhs.v && !(vhs.v = mvhs(ncol)))) {
 		return -1;
 	}
+	mkkn();
 	return 0;
 }
 
+/* lines to infer value types from */
+#define NINF	(1024U)
+
 static size_t
-toklng(const char *ln, size_t lz)
+infr(typ_t *restrict t, const char *s, size_t z, size_t ncol, size_t *coff)
 {
-	const char *const ep = ln + lz;
-	size_t ncol = 1U;
+/* join into T the types of the value fields of the complete lines in S
+ * of size Z, return the number of lines looked at */
+	size_t n = 0U;
+
+	for (const char *eol; n < NINF &&
+		     (eol = memchr(s, '\n', z)) != NULL; n++) {
+		const size_t lz = eol + 1U - s;
+
+		if (tokln1(coff, ncol, s, lz) >= ncol) {
+			for (size_t i = 0U; i < nvcol; i++) {
+				const size_t bo = coff[vcol[i] - 1U];
+				const size_t eo = coff[vcol[i] - 0U];
+				const typ_t x = typ_guess(s + bo, eo - bo - 1U);
 
-	for (const char *lp = ln, *np;
-	     (np = memchr(lp, '\t', ep - lp)); lp = np + 1U) {
-		ncol++;
+				t[i] = typ_join(t[i], x);
+			}
+		}
+		s += lz;
+		z -= lz;
 	}
-	return ncol;
+	return n;
 }
 
-static size_t
-tokln1(size_t *restrict c, size_t nc, const char *ln, size_t lz)
+static int
+stty(rdln_t rd, const char *line, size_t nrd, size_t ncol, size_t *coff)
 {
-	const char *const ep = ln + lz;
-	size_t j = 0U;
+/* settle value types, one per value field, the last one given repeats,
+ * auto ones are inferred from LINE (if any) and the lines buffered
+ * after it, with --agg they follow from the function */
+	const size_t nva = nvhs ?: 1U;
+	typ_t *t;
+
+	if (vtyp == NULL && !(binp && aggf)) {
+		/* plain text */
+		return 0;
+	} else if (UNLIKELY((t = malloc(nva * sizeof(*t))) == NULL)) {
+		return -1;
+	}
+	for (size_t i = 0U; i < nva; i++) {
+		if (aggf) {
+			t[i] = aggf == AGG_COUNT ? TYP_INT : TYP_DBL;
+		} else {
+			t[i] = vtyp[i < ntyp ? i : ntyp - 1U];
+		}
+	}
+	free(vtyp);
+	vtyp = t;
+	ntyp = nva;
 
-	lz -= ln[lz - 1] == '\n';
+	if (aggf && !binp) {
+		/* values are numbers already */
+		goto txt;
+	} else {
+		typ_t x[nva];
+		const char *p;
+		size_t n = 0U;
+		size_t z;
 
-	c[j++] = 0U;
-	for (const char *lp = ln, *np;
-	     j < nc && lp < ep && (np = memchr(lp, '\t', ep - lp));
-	     lp = np + 1U, j++) {
-		c[j] = np + 1U - ln;
+		for (size_t i = 0U; i < nva; i++) {
+			x[i] = TYP_NIL;
+		}
+		if (line != NULL) {
+			n = infr(x, line, nrd, ncol, coff);
+		}
+		z = rdln_peek(&p, rd);
+		if (n < NINF) {
+			(void)infr(x, p, z, ncol, coff);
+		}
+		for (size_t i = 0U; i < nva; i++) {
+			if (t[i] == TYP_NIL) {
+				t[i] = x[i] != TYP_NIL ? x[i] : TYP_STR;
+			}
+		}
 	}
-	c[j] = lz + 1U;
-	return j;
+	for (size_t i = 0U; i < nva; i++) {
+		if (t[i] != TYP_STR || binp) {
+			return 0;
+		}
+	}
+txt:
+	/* nothing to convert */
+	free(vtyp);
+	vtyp = NULL;
+	return 0;
 }
 
-static uint64_t
-hashln(const char *ln, size_t *of)
+static inline uint64_t
+hashln(const char *ln, const size_t *of)
 {
-	uint64_t d = 0U;
-
-	if (!nlhs && lhs.v + 1U) {
-		const size_t bo = of[lhs.v + 0U];
-		const size_t eo = of[lhs.v + 1U];
-		d = hash(ln + bo, eo - bo - 1U);
-	} else if (!nlhs) {
-		d = ~d;
-	} else for (size_t i = 0U; i < nlhs; i++) {
-		const size_t bo = of[lhs.p[i] + 0U];
-		const size_t eo = of[lhs.p[i] + 1U];
-		d ^= hash2(ln + bo, eo - bo - 1U, i);
-	}
-	return d;
+	return kn.hashl(ln, of);
 }
 
-static uint64_t
-hashrn(const char *ln, size_t *of)
+static inline uint64_t
+hashrn(const char *ln, const size_t *of)
 {
-	uint64_t d = 0U;
-
-	if (!nrhs) {
-		const size_t bo = of[rhs.v + 0U];
-		const size_t eo = of[rhs.v + 1U];
-		d = hash(ln + bo, eo - bo - 1);
-	} else for (size_t i = 0U; i < nrhs; i++) {
-		const size_t bo = of[rhs.p[i] + 0U];
-		const size_t eo = of[rhs.p[i] + 1U];
-		d ^= hash2(ln + bo, eo - bo - 1U, i);
-	}
-	return d;
+	return kn.hashr(ln, of);
 }
 
 static ssize_t
@@ -649,152 +1423,1153 @@ find_s(const char *ss, const size_t *of, size_t nc, const char *s, size_t z)
 	return -1;
 }
 
+static int
+lhskeq(const char *k, size_t kz, const char *ln, const size_t *of)
+{
+/* check if LHS of LN spells K of size KZ */
+	return kn.keql(k, kz, ln, of);
+}
+
+static int
+lhseq(const struct grp_s *g, const char *ln, const size_t *of)
+{
+/* check if LHS of LN is that of the current dimension line */
+	return lhskeq(g->dim, g->ndim, ln, of);
+}
+
+static int
+rhseq(const char *ln, const size_t *of, size_t j)
+{
+/* check if RHS of LN is the key of cast column J */
+	const char *k = arena_ptr(&cka, cko[j]);
+	const size_t kz = cko[j + 1U] - cko[j];
+
+	return kn.keqr(k, kz, ln, of);
+}
+
 static ssize_t
-find_c(const uint64_t c)
+find_c(const uint64_t c, const char *ln, const size_t *of)
 {
-	for (size_t j = 0U; j < ncc; j++) {
-		if (cc[j] == c) {
+	size_t p = htab_home(&ccx, c);
+
+	for (size_t j; (j = htab_next(&ccx, c, &p)) != HTAB_NIL;) {
+		if (LIKELY(rhseq(ln, of, j))) {
 			/* found him */
 			return j;
 		}
+		/* hash collision, keep probing */
+	}
+	/* not found */
+	return -1;
+}
+
+static int
+snrf(const char *formula, const char *hn, const size_t *of, size_t nc)
+{
+	static const char *form;
+	const char *elhs, *l;
+	const char *erhs, *r;
+	const char *evhs = NULL, *v = NULL;
+	const char *on;
+	size_t nl, nr, nv = 0U;
+
+	if (UNLIKELY((formula = form ?: formula) == NULL)) {
+		return !form - 1;
+	}
+	if ((elhs = strchr(l = form = formula, '~')) == NULL) {
+		return -1;
+	}
+	if ((erhs = strchr(r = elhs + 1U, '~')) == NULL) {
+		/* value hand side is optional */
+		erhs = r + strlen(r);
+	} else {
+		v = erhs + 1U;
+		evhs = v + strlen(v);
+	}
+
+	for (nl = 0U, on = l; (on = memchr(on, '+', elhs - on)); nl++, on++);
+	for (nr = 0U, on = r; (on = memchr(on, '+', erhs - on)); nr++, on++);
+	if (v) {
+		for (nv = 0U, on = v;
+		     (on = memchr(on, '+', evhs - on)); nv++, on++);
+	}
+
+	if (nl && !lhs.p) {
+		lhs.p = calloc(nlhs = nl + 1U, sizeof(*lhs.p));
+	}
+	if (nr && !rhs.p) {
+		rhs.p = calloc(nrhs = nr + 1U, sizeof(*rhs.p));
+	}
+	if (nv && !vhs.p) {
+		vhs.p = calloc(nvhs = nv + 1U, sizeof(*vhs.p));
+	}
+
+	/* now try and snarf the whole shebang */
+	if (!nl) {
+		goto one_l;
+	}
+	for (nl = 0U; nl < nlhs; nl++, l = on + 1U) {
+		/* try with numbers first */
+		char *tmp;
+		long unsigned int x;
+
+	one_l:
+		on = memchrnul(l, '+', elhs - l);
+		if ((x = strtoul(l, &tmp, 10)) && tmp == on ||
+		    tmp == on && !nlhs) {
+			x--;
+		} else if ((x = find_s(hn, of, nc, l, on - l)) < nc) {
+			;
+		} else {
+			return -1;
+		}
+
+		if (!nlhs) {
+			lhs.v = x;
+		} else {
+			lhs.p[nl] = x;
+		}
+	}
+
+	/* snarf right hand side */
+	if (!nr) {
+		goto one_r;
+	}
+	for (nr = 0U; nr < nrhs; nr++, r = on + 1U) {
+		/* try with numbers first */
+		char *tmp;
+		long unsigned int x;
+
+	one_r:
+		on = memchrnul(r, '+', erhs - r);
+		if ((x = strtoul(r, &tmp, 10)) && tmp == on ||
+		    *tmp == '.' && tmp + 1 == on && !nrhs) {
+			x--;
+		} else if ((x = find_s(hn, of, nc, r, on - r)) < nc) {
+			;
+		} else {
+			return -1;
+		}
+
+		if (!nrhs) {
+			rhs.v = x;
+		} else {
+			rhs.p[nr] = x;
+		}
+	}
+
+	/* snarf value hand side */
+	if (v && !nv) {
+		goto one_v;
+	}
+	for (nv = 0U; nv < nvhs; nv++, v = on + 1U) {
+		/* try with numbers first */
+		char *tmp;
+		long unsigned int x;
+
+	one_v:
+		on = memchrnul(v, '+', evhs - v);
+		if ((x = strtoul(v, &tmp, 10)) && tmp == on ||
+		    *tmp == '.' && tmp + 1 == on && !nvhs) {
+			;
+		} else if ((x = find_s(hn, of, nc, v, on - v)) < nc) {
+			/* one based */
+			x++;
+		} else {
+			return -1;
+		}
+
+		if (!nvhs) {
+			vhs.v = x;
+		} else {
+			vhs.p[nv] = x;
+		}
+	}
+	/* all is good, forget about the formula then */
+	form = NULL;
+	return 0;
+}
+
+static int
+scan(rdln_t rd, const char *line, ssize_t nrd,
+     size_t ncol, size_t *coff, int sfd)
+{
+/* collect cast columns from all lines from LINE onwards,
+ * if SFD is not negative also copy the lines there */
+	obuf_t sp = NULL;
+	int rc = 0;
+
+	if (sfd >= 0 && UNLIKELY((sp = obuf_open(sfd)) == NULL)) {
+		return -1;
+	}
+	for (; nrd > 0; nrd = rdln_getln(&line, rd)) {
+		uint64_t c;
+
+		if (sp != NULL) {
+			obuf_add(sp, line, nrd);
+			if (UNLIKELY(line[nrd - 1U] != '\n')) {
+				obuf_chr(sp, '\n');
+			}
+		}
+		if (UNLIKELY(tokln1(coff, ncol, line, nrd) < ncol)) {
+			/* we'll complain about him in the second pass */
+			continue;
+		}
+		c = hashrn(line, coff);
+		if (find_c(c, line, coff) >= 0) {
+			/* all good */
+			;
+		} else if (UNLIKELY(adcc(line, coff, c) < 0)) {
+			rc = -1;
+			break;
+		}
+	}
+	if (UNLIKELY(obuf_close(sp) < 0)) {
+		rc = -1;
+	}
+	return rc;
+}
+
+/* unsorted mode */
+static size_t
+umem(void)
+{
+/* bytes held in rows */
+	return rwk.z + zrw * sizeof(*rwko) +
+		rwx.z * (sizeof(*rwx.k) + sizeof(*rwx.v));
+}
+
+static size_t
+rmem(void)
+{
+/* bytes taken up by records, by size since capacities outlive runs,
+ * the index of cells starts from scratch with every run though */
+	if (aggf) {
+		const size_t nva = nvhs ?: 1U;
+
+		return nrc * (sizeof(*rcr) + sizeof(*rcc) +
+			      nva * sizeof(*rca)) +
+			rcx.z * (sizeof(*rcx.k) + sizeof(*rcx.v));
+	}
+	return rcv.n + nrc * (sizeof(*rcr) + sizeof(*rcc) + sizeof(*rco));
+}
+
+static void
+uclr(void)
+{
+	/* rows start from scratch in every pass */
+	htab_fini(&rwx);
+	arena_fini(&rwk);
+	free(rwko);
+	rwko = NULL;
+	zrw = 0U;
+	free(rwp);
+	rwp = NULL;
+	arena_reset(&rcv);
+	htab_fini(&rcx);
+	nrw = 0U;
+	nrc = 0U;
+	for (size_t i = 0U; i < nrrn; i++) {
+		close(rrn[i]);
+	}
+	nrrn = 0U;
+	return;
+}
+
+static ssize_t
+find_r(const uint64_t d, const char *ln, const size_t *of)
+{
+	size_t p = htab_home(&rwx, d);
+
+	for (size_t r; (r = htab_next(&rwx, d, &p)) != HTAB_NIL;) {
+		const char *k = arena_ptr(&rwk, rwko[r]);
+		const size_t kz = rwko[r + 1U] - rwko[r];
+
+		if (LIKELY(lhskeq(k, kz, ln, of))) {
+			/* found him */
+			return r;
+		}
+	}
+	/* not found */
+	return -1;
+}
+
+static ssize_t
+adrw(const uint64_t d, const char *ln, const size_t *of)
+{
+	if (UNLIKELY(nrw + 1U >= zrw)) {
+		const size_t nuz = (zrw * 2U) ?: 256U;
+
+		rwko = realloc(rwko, nuz * sizeof(*rwko));
+		if (UNLIKELY(rwko == NULL)) {
+			return -1;
+		}
+		zrw = nuz;
+	}
+	/* dimension line is what we use as key */
+	mkdim(&g0, ln, of);
+	rwko[nrw] = rwk.n;
+	if (UNLIKELY(arena_add(&rwk, g0.dim, g0.ndim) == ARENA_NIL)) {
+		return -1;
+	} else if (UNLIKELY(htab_put(&rwx, d, nrw) < 0)) {
+		return -1;
+	}
+	rwko[nrw + 1U] = rwk.n;
+	return nrw++;
+}
+
+static int
+adrc(size_t r, size_t j, const char *ln, const size_t *of)
+{
+	const size_t len = kn.szv(of);
+	size_t o;
+
+	if (UNLIKELY(nrc >= zrc)) {
+		const size_t nuz = (zrc * 2U) ?: 1024U;
+
+		rcr = realloc(rcr, nuz * sizeof(*rcr));
+		rcc = realloc(rcc, nuz * sizeof(*rcc));
+		rco = realloc(rco, nuz * sizeof(*rco));
+
+		if (UNLIKELY(rcr == NULL)) {
+			return -1;
+		} else if (UNLIKELY(rcc == NULL)) {
+			return -1;
+		} else if (UNLIKELY(rco == NULL)) {
+			return -1;
+		}
+		zrc = nuz;
+	}
+	if (UNLIKELY((o = arena_alloc(&rcv, len)) == ARENA_NIL)) {
+		return -1;
+	}
+	kn.cpv(arena_ptr(&rcv, o), ln, of);
+	rcr[nrc] = r;
+	rcc[nrc] = j;
+	rco[nrc] = rcv.n;
+	nrc++;
+	return 0;
+}
+
+static int
+agrc(size_t r, size_t j, const char *ln, const size_t *of)
+{
+/* aggregate the values of LN into the cell of row R and cast column J */
+	const size_t nva = nvhs ?: 1U;
+	const uint64_t k = (uint64_t)r << 32U ^ j;
+	size_t p = htab_home(&rcx, k);
+	struct agg_s *a;
+	size_t i;
+
+	while ((i = htab_next(&rcx, k, &p)) != HTAB_NIL) {
+		if (LIKELY(rcr[i] == r && rcc[i] == j)) {
+			goto agg;
+		}
+	}
+	/* new cell */
+	if (UNLIKELY(nrc >= zrc)) {
+		const size_t nuz = (zrc * 2U) ?: 1024U;
+
+		rcr = realloc(rcr, nuz * sizeof(*rcr));
+		rcc = realloc(rcc, nuz * sizeof(*rcc));
+		rca = realloc(rca, nuz * nva * sizeof(*rca));
+
+		if (UNLIKELY(rcr == NULL)) {
+			return -1;
+		} else if (UNLIKELY(rcc == NULL)) {
+			return -1;
+		} else if (UNLIKELY(rca == NULL)) {
+			return -1;
+		}
+		zrc = nuz;
+	}
+	if (UNLIKELY(htab_put(&rcx, k, nrc) < 0)) {
+		return -1;
+	}
+	i = nrc++;
+	rcr[i] = r;
+	rcc[i] = j;
+	memset(rca + i * nva, 0, nva * sizeof(*rca));
+agg:
+	a = rca + i * nva;
+	for (size_t m = 0U; m < nvcol; m++) {
+		const size_t bo = of[vcol[m] - 1U];
+		const size_t eo = of[vcol[m] - 0U];
+		agg1(a + m, ln + bo, eo - bo - 1U);
+	}
+	return 0;
+}
+
+static int
+rwcmp(const void *x, const void *y)
+{
+	const size_t r = *(const size_t*)x;
+	const size_t s = *(const size_t*)y;
+	const size_t rz = rwko[r + 1U] - rwko[r];
+	const size_t sz = rwko[s + 1U] - rwko[s];
+	const int c = memcmp(arena_ptr(&rwk, rwko[r]), arena_ptr(&rwk, rwko[s]),
+			     rz < sz ? rz : sz);
+
+	return c ?: (rz > sz) - (rz < sz);
+}
+
+static int
+rord(void)
+{
+/* put rows in output order, in order of appearance or sorted */
+	if (UNLIKELY((rwp = malloc(nrw * sizeof(*rwp) + 1U)) == NULL)) {
+		return -1;
+	}
+	for (size_t r = 0U; r < nrw; r++) {
+		rwp[r] = r;
+	}
+	if (srtp) {
+		qsort(rwp, nrw, sizeof(*rwp), rwcmp);
+	}
+	return 0;
+}
+
+static int
+rsrt(size_t **rb, size_t **ri)
+{
+/* bucket records by row, row R's are RI[RB[R]] to RI[RB[R + 1U] - 1U] */
+	size_t *b, *i;
+
+	if (UNLIKELY((b = calloc(nrw + 1U, sizeof(*b))) == NULL)) {
+		return -1;
+	} else if (UNLIKELY((i = malloc(nrc * sizeof(*i) + 1U)) == NULL)) {
+		free(b);
+		return -1;
+	}
+	/* count records per row and turn counts into offsets */
+	for (size_t k = 0U; k < nrc; k++) {
+		b[rcr[k] + 1U]++;
+	}
+	for (size_t r = 0U; r < nrw; r++) {
+		b[r + 1U] += b[r];
+	}
+	/* this moves every offset up by one row ... */
+	for (size_t k = 0U; k < nrc; k++) {
+		i[b[rcr[k]]++] = k;
+	}
+	/* ... so move them back */
+	memmove(b + 1U, b, nrw * sizeof(*b));
+	b[0U] = 0U;
+	*rb = b;
+	*ri = i;
+	return 0;
+}
+
+static int
+feed(obuf_t ro, size_t r, size_t j, const char *v, size_t z)
+{
+/* hand value V of size Z of row R and cast column J to the current
+ * group, or write it to run RO */
+	size_t o;
+
+	if (ro != NULL) {
+		obuf_fmt(ro, "%zu\t%zu\t", r, j);
+		obuf_add(ro, v, z);
+		obuf_chr(ro, '\n');
+	} else if (UNLIKELY((o = bang0(&g0, j, z)) == ARENA_NIL)) {
+		error("\
+Error: cannot allocate memory to hold a row");
+		return -1;
+	} else {
+		memcpy(arena_ptr(&g0.val, o), v, z);
+	}
+	return 0;
+}
+
+static void
+fagg(size_t j, const struct agg_s *b)
+{
+/* fold accumulators B of cast column J into the current group */
+	const size_t nva = nvhs ?: 1U;
+	struct agg_s *a = agcl(&g0, j);
+
+	for (size_t k = 0U; k < nva; k++) {
+		agg2(a + k, b + k);
+	}
+	return;
+}
+
+static void
+wagg(obuf_t ro, size_t r)
+{
+/* write the accumulators of the current group, row R, to run RO */
+	const size_t nva = nvhs ?: 1U;
+
+	for (size_t j = 0U; j < ncc; j++) {
+		const struct agg_s *a = g0.cca + j * nva;
+
+		if (g0.cag[j] != g0.agn) {
+			continue;
+		}
+		obuf_fmt(ro, "%zu\t%zu", r, j);
+		for (size_t k = 0U; k < nva; k++) {
+			obuf_fmt(ro, "\t%zu\t%a", a[k].n, a[k].x);
+		}
+		obuf_chr(ro, '\n');
+	}
+	return;
+}
+
+static void
+pagg(struct agg_s *restrict b, const char *v)
+{
+/* read accumulators back as written by wagg(), V is at the tab
+ * preceding the first one */
+	const size_t nva = nvhs ?: 1U;
+	char *p;
+
+	for (size_t k = 0U; k < nva; k++, v = p) {
+		b[k].n = strtoul(v + 1U, &p, 10);
+		b[k].x = strtod(p + 1U, &p);
+	}
+	return;
+}
+
+static int
+rwlk(obuf_t o, obuf_t ro, size_t nr, int memp)
+{
+/* go through rows in output order with the records of the first NR runs
+ * and, if MEMP, those in memory, rows are printed to O or, if RO is
+ * given, their records are written to RO as another run, with --agg
+ * as one record per cell */
+	/* records by row, in memory */
+	size_t *rb = NULL, *ri = NULL;
+	/* current line of every run */
+	rdln_t rd[NRRN];
+	const char *ln[NRRN];
+	ssize_t lz[NRRN];
+	int rc = 0;
+
+	if (memp && UNLIKELY(rsrt(&rb, &ri) < 0)) {
+		return -1;
+	}
+	for (size_t q = 0U; q < nr; q++) {
+		rd[q] = NULL;
+	}
+	for (size_t q = 0U; q < nr; q++) {
+		if (UNLIKELY(lseek(rrn[q], 0, SEEK_SET) < 0 ||
+			     (rd[q] = rdln_open(rrn[q])) == NULL)) {
+			rc = -1;
+			goto out;
+		}
+		lz[q] = rdln_getln(ln + q, rd[q]);
+	}
+
+	for (size_t k = 0U; k < nrw; k++) {
+		const size_t r = rwp[k];
+
+		if (ro == NULL || aggf) {
+			rclr(&g0);
+		}
+		if (ro == NULL) {
+			dset(&g0, arena_ptr(&rwk, rwko[r]),
+			     rwko[r + 1U] - rwko[r]);
+		}
+		/* runs first, they hold the older records */
+		for (size_t q = 0U; q < nr; q++) {
+			for (; lz[q] > 0; lz[q] = rdln_getln(ln + q, rd[q])) {
+				const char *const e = ln[q] + lz[q] -
+					(ln[q][lz[q] - 1U] == '\n');
+				char *v;
+				size_t j;
+
+				if (strtoul(ln[q], &v, 10) != r) {
+					/* records of later rows */
+					break;
+				}
+				j = strtoul(v + 1U, &v, 10);
+				if (aggf) {
+					struct agg_s b[nvhs ?: 1U];
+
+					pagg(b, v);
+					fagg(j, b);
+				} else if (UNLIKELY(feed(ro, r, j, v + 1U,
+							 e - v - 1U) < 0)) {
+					rc = -1;
+					goto out;
+				}
+			}
+		}
+		for (size_t m = memp ? rb[r] : 0U,
+			     n = memp ? rb[r + 1U] : 0U; m < n; m++) {
+			const size_t i = ri[m];
+			size_t bo, eo;
+
+			if (aggf) {
+				fagg(rcc[i], rca + i * (nvhs ?: 1U));
+				continue;
+			}
+			bo = i ? rco[i - 1U] : 0U;
+			eo = rco[i];
+			if (UNLIKELY(feed(ro, r, rcc[i],
+					  arena_ptr(&rcv, bo), eo - bo) < 0)) {
+				rc = -1;
+				goto out;
+			}
+		}
+		if (ro == NULL && UNLIKELY(prnt(&g0, o) < 0)) {
+			rc = -1;
+			goto out;
+		} else if (ro != NULL && aggf) {
+			wagg(ro, r);
+		}
+	}
+	if (ro == NULL) {
+		bfls(&g0, o);
+	}
+out:
+	for (size_t q = 0U; q < nr; q++) {
+		if (rd[q] != NULL) {
+			rdln_close(rd[q]);
+		}
+	}
+	free(ri);
+	free(rb);
+	return rc;
+}
+
+static int
+tmpfd(void)
+{
+/* anonymous temporary file, gone when closed */
+	FILE *f;
+	int fd;
+
+	if (UNLIKELY((f = tmpfile()) == NULL)) {
+		return -1;
+	}
+	fd = dup(fileno(f));
+	fclose(f);
+	return fd;
+}
+
+static int
+rspl(void)
+{
+/* write records to another run, sorted by output order of rows,
+ * rows are fixed from now on, runs are merged once there's NRRN */
+	int fd;
+	obuf_t ro;
+	int rc;
+
+	if (rwp == NULL && UNLIKELY(rord() < 0)) {
+		return -1;
+	} else if (UNLIKELY((fd = tmpfd()) < 0)) {
+		return -1;
+	} else if (UNLIKELY((ro = obuf_open(fd)) == NULL)) {
+		close(fd);
+		return -1;
+	}
+	rc = rwlk(NULL, ro, 0U, 1);
+	rc = obuf_close(ro) < 0 ? -1 : rc;
+	rrn[nrrn++] = fd;
+	arena_reset(&rcv);
+	htab_fini(&rcx);
+	nrc = 0U;
+	if (UNLIKELY(rc) || nrrn < NRRN) {
+		return rc;
+	}
+	/* merge all runs into one */
+	if (UNLIKELY((fd = tmpfd()) < 0)) {
+		return -1;
+	} else if (UNLIKELY((ro = obuf_open(fd)) == NULL)) {
+		close(fd);
+		return -1;
+	}
+	rc = rwlk(NULL, ro, nrrn, 0);
+	rc = obuf_close(ro) < 0 ? -1 : rc;
+	for (size_t q = 0U; q < nrrn; q++) {
+		close(rrn[q]);
+	}
+	rrn[0U] = fd;
+	nrrn = 1U;
+	return rc;
+}
+
+static int
+prrw(obuf_t o)
+{
+/* print rows to O, in order of appearance or sorted */
+	if (rwp == NULL && UNLIKELY(rord() < 0)) {
+		return -1;
+	}
+	return rwlk(o, NULL, nrrn, 1);
+}
+
+static size_t
+keyz(const char *ln, size_t lz)
+{
+/* length of the LHS key at the beginning of output line LN */
+	const char *p = ln, *const ep = ln + lz - (lz && ln[lz - 1U] == '\n');
+
+	for (size_t i = 0U, n = nlhs ?: 1U; i < n && p < ep; i++) {
+		p = memchrnul(p, '\t', ep - p) + 1U;
+	}
+	return p > ln ? p - ln - 1U : 0U;
+}
+
+static int
+mrg(obuf_t o, const int *fd, size_t n)
+{
+/* merge sorted runs FD[0U..N), keys are disjoint across runs
+ * so rows spanning several lines stay together */
+	rdln_t rd[n];
+	const char *ln[n];
+	ssize_t lz[n];
+	size_t kz[n];
+	int rc = 0;
+
+	for (size_t i = 0U; i < n; i++) {
+		rd[i] = NULL;
+		lz[i] = -1;
+		if (UNLIKELY(lseek(fd[i], 0, SEEK_SET) < 0 ||
+			     (rd[i] = rdln_open(fd[i])) == NULL)) {
+			rc = -1;
+			continue;
+		}
+		if ((lz[i] = rdln_getln(ln + i, rd[i])) > 0) {
+			kz[i] = keyz(ln[i], lz[i]);
+		}
+	}
+	for (size_t m; !rc; ) {
+		/* find the run with the least key */
+		m = n;
+		for (size_t i = 0U; i < n; i++) {
+			int c;
+
+			if (lz[i] <= 0) {
+				continue;
+			} else if (m >= n) {
+				m = i;
+				continue;
+			}
+			c = memcmp(ln[i], ln[m], kz[i] < kz[m] ? kz[i] : kz[m]);
+			if (c < 0 || !c && kz[i] < kz[m]) {
+				m = i;
+			}
+		}
+		if (m >= n) {
+			/* all runs exhausted */
+			break;
+		}
+		obuf_add(o, ln[m], lz[m]);
+		if ((lz[m] = rdln_getln(ln + m, rd[m])) > 0) {
+			kz[m] = keyz(ln[m], lz[m]);
+		}
+	}
+	for (size_t i = 0U; i < n; i++) {
+		if (rd[i] != NULL) {
+			rdln_close(rd[i]);
+		}
+	}
+	return rc;
+}
+
+static int
+mrun(int *fd, size_t *n)
+{
+/* merge sorted runs FD[0U..N) into one, FD[0U] */
+	const int mfd = tmpfd();
+	obuf_t mo;
+	int rc;
+
+	if (UNLIKELY(mfd < 0)) {
+		return -1;
+	} else if (UNLIKELY((mo = obuf_open(mfd)) == NULL)) {
+		close(mfd);
+		return -1;
+	}
+	rc = mrg(mo, fd, *n);
+	rc = obuf_close(mo) < 0 ? -1 : rc;
+	for (size_t i = 0U; i < *n; i++) {
+		close(fd[i]);
+	}
+	fd[0U] = mfd;
+	*n = 1U;
+	return rc;
+}
+
+static int
+pass(rdln_t rd, const char *line, ssize_t nrd,
+     size_t ncol, size_t *coff, int adcp, int *sfd)
+{
+/* collect rows and records of all lines from LINE onwards,
+ * once rows exhaust their share of the memory budget lines of unseen
+ * LHS keys are spilled to a temporary file whose descriptor is stored
+ * in SFD, records exhausting theirs are written to runs */
+	obuf_t sp = NULL;
+	size_t nr = 0U;
+	int rc = 0;
+
+	for (; nrd > 0; nrd = rdln_getln(&line, rd)) {
+		uint64_t d, c;
+		ssize_t r, j;
+		size_t nf;
+
+		nr++;
+		if (UNLIKELY((nf = tokln1(coff, ncol, line, nrd)) < ncol)) {
+			errno = 0, error("\
+Error: line %zu has only %zu columns, expected %zu", nr, nf, ncol);
+			rc = 2;
+			break;
+		}
+
+		/* find row, or make up a new one */
+		d = hashln(line, coff);
+		if ((r = find_r(d, line, coff)) >= 0) {
+			;
+		} else if (sp == NULL && rwp == NULL &&
+			   (!nrw || umem() <= mmax / 2U)) {
+			/* rows get half the budget, records the other */
+			if (UNLIKELY((r = adrw(d, line, coff)) < 0)) {
+				goto nomem;
+			}
+		} else if (sp == NULL &&
+			   UNLIKELY((*sfd = tmpfd()) < 0 ||
+				    (sp = obuf_open(*sfd)) == NULL)) {
+			error("\
+Error: cannot open spill file");
+			rc = -1;
+			break;
+		} else {
+			/* no new rows in this pass, leave him for the next */
+			obuf_add(sp, line, nrd);
+			if (UNLIKELY(line[nrd - 1U] != '\n')) {
+				obuf_chr(sp, '\n');
+			}
+		}
+
+		/* store value? */
+		if (!nrhs && !(rhs.v + 1U)) {
+			/* nope */
+			continue;
+		}
+		/* cast columns are collected even for spilled lines */
+		c = hashrn(line, coff);
+		if ((j = find_c(c, line, coff)) >= 0) {
+			;
+		} else if (!adcp) {
+			/* don't want him */
+			continue;
+		} else if (UNLIKELY((j = adcc(line, coff, c)) < 0)) {
+			goto nomem;
+		}
+		if (r < 0) {
+			/* spilled */
+			continue;
+		} else if (UNLIKELY((aggf
+				     ? agrc(r, j, line, coff)
+				     : adrc(r, j, line, coff)) < 0)) {
+			goto nomem;
+		} else if (rmem() > mmax / 4U && UNLIKELY(rspl() < 0)) {
+			/* records' capacities are up to twice their size */
+			error("\
+Error: cannot write run of records");
+			rc = -1;
+			break;
+		}
 	}
-	/* not found */
-	return -1;
+out:
+	if (UNLIKELY(obuf_close(sp) < 0)) {
+		error("\
+Error: cannot write spill file");
+		rc = -1;
+	}
+	return rc;
+
+nomem:
+	error("\
+Error: cannot allocate memory for line %zu", nr);
+	rc = -1;
+	goto out;
 }
 
 static int
-snrf(const char *formula, const char *hn, const size_t *of, size_t nc)
+unsr(rdln_t rd, const char *line, ssize_t nrd, size_t ncol, size_t *coff,
+     const char *hn, const size_t *hoff)
 {
-	static const char *form;
-	const char *elhs, *l;
-	const char *erhs, *r;
-	const char *evhs = NULL, *v = NULL;
-	const char *on;
-	size_t nl, nr, nv = 0U;
+/* go through the input in passes, in each pass rows are collected
+ * until the memory budget is exhausted, lines of other LHS keys are
+ * spilled and make up the input of the next pass, this keeps rows in
+ * order of appearance; sorted output is merged from one run per pass */
+	/* snarf cast columns unless specified */
+	int adcp = !ncc;
+	int *run = NULL;
+	size_t nrun = 0U;
+	/* spill being read */
+	int pfd = -1;
+	int cprp = 0;
+	int rc = 0;
 
-	if (UNLIKELY((formula = form ?: formula) == NULL)) {
-		return !form - 1;
-	}
-	if ((elhs = strchr(l = form = formula, '~')) == NULL) {
-		return -1;
-	}
-	if ((erhs = strchr(r = elhs + 1U, '~')) == NULL) {
-		/* value hand side is optional */
-		erhs = r + strlen(r);
-	} else {
-		v = erhs + 1U;
-		evhs = v + strlen(v);
-	}
+	for (int sfd = -1;; sfd = -1) {
+		rc = pass(rd, line, nrd, ncol, coff, adcp, &sfd);
+		if (adcp) {
+			/* all cast columns are known now */
+			if (UNLIKELY(mtcc() < 0)) {
+				error("\
+Error: cannot sort cast columns");
+				rc = -1;
+			}
+			adcp = 0;
+		}
+		if (!rc && !cprp && cnmp) {
+			/* print col names */
+			phdr(hn, hoff);
+		}
+		cprp = 1;
 
-	for (nl = 0U, on = l; (on = memchr(on, '+', elhs - on)); nl++, on++);
-	for (nr = 0U, on = r; (on = memchr(on, '+', erhs - on)); nr++, on++);
-	if (v) {
-		for (nv = 0U, on = v;
-		     (on = memchr(on, '+', evhs - on)); nv++, on++);
-	}
+		if (rc) {
+			;
+		} else if (!srtp || sfd < 0 && !nrun) {
+			/* straight to stdout */
+			rc = prrw(ob);
+		} else {
+			/* keep as run */
+			int *nu = realloc(run, (nrun + 1U) * sizeof(*run));
+			obuf_t ro;
+
+			if (UNLIKELY(nu == NULL)) {
+				rc = -1;
+			} else if ((run = nu, nu[nrun] = tmpfd()) < 0) {
+				rc = -1;
+			} else if ((ro = obuf_open(run[nrun++])) == NULL) {
+				rc = -1;
+			} else {
+				rc = prrw(ro);
+				rc = obuf_close(ro) < 0 ? -1 : rc;
+			}
+			if (!rc && nrun >= NRRN) {
+				/* don't let runs pile up */
+				rc = mrun(run, &nrun);
+			}
+			if (UNLIKELY(rc)) {
+				error("\
+Error: cannot write sorted run");
+			}
+		}
+		uclr();
 
-	if (nl && !lhs.p) {
-		lhs.p = calloc(nlhs = nl + 1U, sizeof(*lhs.p));
+		if (pfd >= 0) {
+			rdln_close(rd);
+			close(pfd);
+		}
+		if (UNLIKELY(rc) && sfd >= 0) {
+			close(sfd);
+			break;
+		} else if (rc || (pfd = sfd) < 0) {
+			break;
+		}
+		/* next pass over what's been spilled */
+		if (UNLIKELY(lseek(pfd, 0, SEEK_SET) < 0 ||
+			     (rd = rdln_open(pfd)) == NULL)) {
+			error("\
+Error: cannot read spill file");
+			close(pfd);
+			rc = -1;
+			break;
+		}
+		nrd = rdln_getln(&line, rd);
 	}
-	if (nr && !rhs.p) {
-		rhs.p = calloc(nrhs = nr + 1U, sizeof(*rhs.p));
+	if (!rc && nrun) {
+		rc = mrg(ob, run, nrun);
 	}
-	if (nv && !vhs.p) {
-		vhs.p = calloc(nvhs = nv + 1U, sizeof(*vhs.p));
+	for (size_t i = 0U; i < nrun; i++) {
+		close(run[i]);
 	}
+	free(run);
+	return rc;
+}
 
-	/* now try and snarf the whole shebang */
-	if (!nl) {
-		goto one_l;
-	}
-	for (nl = 0U; nl < nlhs; nl++, l = on + 1U) {
-		/* try with numbers first */
-		char *tmp;
-		long unsigned int x;
+/* multi-threaded mode */
+#define CHNKZ	(1U << 20U)
 
-	one_l:
-		on = memchrnul(l, '+', elhs - l);
-		if ((x = strtoul(l, &tmp, 10)) && tmp == on ||
-		    tmp == on && !nlhs) {
-			x--;
-		} else if ((x = find_s(hn, of, nc, l, on - l)) < nc) {
-			;
-		} else {
-			return -1;
+struct wrk_s {
+	struct grp_s g;
+	size_t ncol;
+	size_t *coff;
+};
+
+static int
+wrk1(void *wst, obuf_t o, const char *buf, size_t bz, size_t nr)
+{
+/* cast chunk BUF of size BZ, which consists of whole groups and whose
+ * first line is line NR + 1U */
+	struct wrk_s *w = wst;
+	const char *const eb = buf + bz;
+	uint64_t last_d = 0ULL;
+	int rc = 0;
+
+	for (const char *ln = buf, *eol; ln < eb; ln = eol) {
+		size_t nf;
+		uint64_t d;
+		ssize_t j;
+
+		/* chunks consist of whole lines */
+		eol = (const char*)memchr(ln, '\n', eb - ln) + 1U;
+		nr++;
+		nf = tokln1(w->coff, w->ncol, ln, eol - ln);
+		if (UNLIKELY(nf < w->ncol)) {
+			errno = 0, error("\
+Error: line %zu has only %zu columns, expected %zu", nr, nf, w->ncol);
+			rc = 2;
+			break;
 		}
 
-		if (!nlhs) {
-			lhs.v = x;
-		} else {
-			lhs.p[nl] = x;
+		/* hash dimension columns */
+		d = hashln(ln, w->coff);
+		if (UNLIKELY(!last_d)) {
+			rset(&w->g, ln, w->coff);
+		} else if (UNLIKELY(d != last_d ||
+				    !lhseq(&w->g, ln, w->coff))) {
+			if (UNLIKELY(prnt(&w->g, o) < 0)) {
+				rc = -1;
+				break;
+			}
+			rset(&w->g, ln, w->coff);
 		}
-	}
+		last_d = d;
 
-	/* snarf right hand side */
-	if (!nr) {
-		goto one_r;
+		/* store value? */
+		if (!nrhs && !(rhs.v + 1U)) {
+			/* nope */
+			continue;
+		} else if ((j = find_c(hashrn(ln, w->coff), ln, w->coff)) < 0) {
+			/* don't want him */
+			continue;
+		}
+		if (UNLIKELY(bang(&w->g, ln, w->coff, j) < 0)) {
+			error("\
+Error: cannot allocate memory for line %zu", nr);
+			rc = -1;
+			break;
+		}
 	}
-	for (nr = 0U; nr < nrhs; nr++, r = on + 1U) {
-		/* try with numbers first */
-		char *tmp;
-		long unsigned int x;
+	/* print the last one */
+	if (rc >= 0 && UNLIKELY(prnt(&w->g, o) < 0)) {
+		rc = -1;
+	}
+	bfls(&w->g, o);
+	/* and forget about him */
+	w->g.ndim = 0U;
+	return rc;
+}
 
-	one_r:
-		on = memchrnul(r, '+', erhs - r);
-		if ((x = strtoul(r, &tmp, 10)) && tmp == on ||
-		    *tmp == '.' && tmp + 1 == on && !nrhs) {
-			x--;
-		} else if ((x = find_s(hn, of, nc, r, on - r)) < nc) {
-			;
-		} else {
-			return -1;
-		}
+static int
+pll(rdln_t rd, const char *line, ssize_t nrd,
+    size_t ncol, size_t *coff, size_t nr)
+{
+/* cut input, from LINE onwards, into chunks of whole groups and have
+ * them cast by NTHR workers, output is in input order */
+	struct wrk_s w[nthr];
+	void *wst[nthr];
+	/* dimension line of the line that filled the current chunk */
+	struct grp_s gk = {NULL};
+	ppln_t p = NULL;
+	char *buf = NULL;
+	size_t bi = 0U;
+	size_t bz = 0U;
+	/* lines before the current chunk */
+	size_t nr0 = nr;
+	/* whether to cut at the next group boundary */
+	int cutp = 0;
+	int rc = 0;
 
-		if (!nrhs) {
-			rhs.v = x;
-		} else {
-			rhs.p[nr] = x;
+	memset(w, 0, sizeof(w));
+	for (size_t i = 0U; i < nthr; i++) {
+		w[i].ncol = ncol;
+		w[i].coff = calloc(ncol + 1U, sizeof(*w[i].coff));
+		if (UNLIKELY(w[i].coff == NULL || mkgrp(&w[i].g, ncc) < 0)) {
+			error("\
+Error: cannot allocate memory for worker %zu", i);
+			rc = -1;
+			goto out;
 		}
+		wst[i] = w + i;
 	}
-
-	/* snarf value hand side */
-	if (v && !nv) {
-		goto one_v;
+	if (UNLIKELY((p = ppln_open(nthr, wrk1, wst, ob)) == NULL)) {
+		error("\
+Error: cannot set up worker threads");
+		rc = -1;
+		goto out;
 	}
-	for (nv = 0U; nv < nvhs; nv++, v = on + 1U) {
-		/* try with numbers first */
-		char *tmp;
-		long unsigned int x;
 
-	one_v:
-		on = memchrnul(v, '+', evhs - v);
-		if ((x = strtoul(v, &tmp, 10)) && tmp == on ||
-		    *tmp == '.' && tmp + 1 == on && !nvhs) {
-			;
-		} else if ((x = find_s(hn, of, nc, v, on - v)) < nc) {
-			/* one based */
-			x++;
-		} else {
-			return -1;
+	for (; nrd > 0; nrd = rdln_getln(&line, rd)) {
+		if (cutp) {
+			const size_t nf = tokln1(coff, ncol, line, nrd);
+
+			if (nf < ncol || !lhskeq(gk.dim, gk.ndim, line, coff)) {
+				/* another group, cut here */
+				rc = ppln_push(p, buf, bi, nr0);
+				buf = NULL;
+				bi = bz = 0U;
+				nr0 = nr;
+				cutp = 0;
+				if (UNLIKELY(rc)) {
+					break;
+				}
+			}
+		}
+		if (UNLIKELY(bi + nrd >= bz)) {
+			while ((bz = (bz * 2U) ?: 2U * CHNKZ) <= bi + nrd);
+			if (UNLIKELY((buf = realloc(buf, bz)) == NULL)) {
+				error("\
+Error: cannot allocate memory for line %zu", nr + 1U);
+				rc = -1;
+				break;
+			}
+		}
+		memcpy(buf + bi, line, nrd);
+		bi += nrd;
+		if (UNLIKELY(line[nrd - 1U] != '\n')) {
+			buf[bi++] = '\n';
 		}
+		nr++;
 
-		if (!nvhs) {
-			vhs.v = x;
-		} else {
-			vhs.p[nv] = x;
+		if (!cutp && bi >= CHNKZ) {
+			/* cut once this line's group is over */
+			if (UNLIKELY(tokln1(coff, ncol, line, nrd) < ncol)) {
+				/* or now, the worker will complain */
+				rc = ppln_push(p, buf, bi, nr0);
+				buf = NULL;
+				bi = bz = 0U;
+				nr0 = nr;
+				if (UNLIKELY(rc)) {
+					break;
+				}
+				continue;
+			}
+			mkdim(&gk, line, coff);
+			cutp = 1;
 		}
 	}
-	/* all is good, forget about the formula then */
-	form = NULL;
-	return 0;
+	if (bi && !rc) {
+		rc = ppln_push(p, buf, bi, nr0);
+		buf = NULL;
+	}
+	with (int prc = ppln_close(p)) {
+		rc = prc ?: rc;
+	}
+
+out:
+	free(buf);
+	free(gk.dim);
+	for (size_t i = 0U; i < nthr; i++) {
+		frgrp(&w[i].g);
+		free(w[i].coff);
+	}
+	return rc;
 }
 
 static int
-proc1(void)
+proc1(rdln_t rd)
 {
 	int rc = 0;
-	char *line = NULL;
-	size_t llen = 0U;
+	const char *line;
 	ssize_t nrd;
 	size_t ncol;
 	size_t *coff;
@@ -805,9 +2580,14 @@ proc1(void)
 	size_t nr = 0U;
 	/* last dimension hash */
 	uint64_t last_d = 0ULL;
+	/* whether col names have been printed */
+	int cprp = 0;
+	/* copy of the input for the second pass */
+	rdln_t sr = NULL;
+	int sfd = -1;
 
 	/* probe */
-	if (UNLIKELY((nrd = getline(&line, &llen, stdin)) < 0)) {
+	if (UNLIKELY((nrd = rdln_getln(&line, rd)) < 0)) {
 		error("\
 Error: cannot read lines");
 		rc = -1;
@@ -829,11 +2609,22 @@ Error: fewer columns present than needed for LHS~RHS and value");
 Error: cannot allocate memory to hold one line");
 		rc = -1;
 		goto out;
+	} else if (!hdrp && UNLIKELY(stty(rd, line, nrd, ncol, coff) < 0)) {
+		error("\
+Error: cannot set up value types");
+		rc = -1;
+		goto err;
 	}
 
-	if (!hdrp && ncc) {
+	if (!hdrp && unsp) {
+		rc = unsr(rd, line, nrd, ncol, coff, NULL, NULL);
+		goto err;
+	} else if (!hdrp && ncc) {
 		/* go straight to tok loop */
 		goto tok;
+	} else if (!hdrp && dscp && (rhs.v + 1U)) {
+		/* collect cast columns from the whole input first */
+		goto scan;
 	} else if (!hdrp) {
 		/* implies !ncc, we need to snarf cast cols then */
 		goto scctok;
@@ -861,17 +2652,67 @@ Error: cannot interpret formula");
 Error: fewer columns present than needed for LHS~RHS and value");
 		rc = -1;
 		goto err;
+	} else if (UNLIKELY(stty(rd, NULL, 0U, ncol, coff) < 0)) {
+		error("\
+Error: cannot set up value types");
+		rc = -1;
+		goto err;
 	}
 
+	if (unsp) {
+		nrd = rdln_getln(&line, rd);
+		rc = unsr(rd, line, nrd, ncol, coff, hn, hoff);
+		goto err;
+	}
 	/* depending on whether cast cols are specified explicitly */
 	if (ncc) {
 		/* yea we know what we want, invalidate current line */
-		nrd = getline(&line, &llen, stdin);
+		nrd = rdln_getln(&line, rd);
+		goto tok;
+	} else if (dscp && (rhs.v + 1U)) {
+		/* first pass, collect cast columns from the whole input */
+		nrd = rdln_getln(&line, rd);
+	scan:
+		if (!rdln_stablep(rd) && UNLIKELY((sfd = tmpfd()) < 0)) {
+			error("\
+Error: cannot open temporary file for the input");
+			rc = -1;
+			goto err;
+		} else if (UNLIKELY(scan(rd, line, nrd, ncol, coff, sfd) < 0)) {
+			error("\
+Error: cannot collect cast columns");
+			rc = -1;
+			goto err;
+		}
+		if (UNLIKELY(mtcc() < 0)) {
+			error("\
+Error: cannot sort cast columns");
+			rc = -1;
+			goto err;
+		}
+		/* second pass, either over the copy or the original */
+		if (sfd >= 0 &&
+		    UNLIKELY(lseek(sfd, 0, SEEK_SET) < 0 ||
+			     (rd = sr = rdln_open(sfd)) == NULL)) {
+			error("\
+Error: cannot read temporary copy of the input");
+			rc = -1;
+			goto err;
+		} else if (sfd < 0 && UNLIKELY(rdln_rewind(rd) < 0)) {
+			error("\
+Error: cannot rewind input");
+			rc = -1;
+			goto err;
+		} else if (sfd < 0 && hdrp) {
+			/* skip header */
+			(void)rdln_getln(&line, rd);
+		}
+		nrd = rdln_getln(&line, rd);
 		goto tok;
 	}
 
 	/* snarf first complete group to obtain cast columns */
-	while ((nrd = getline(&line, &llen, stdin)) > 0) {
+	while ((nrd = rdln_getln(&line, rd)) > 0) {
 	scctok:
 		nr++;
 		size_t nf = tokln1(coff, ncol, line, nrd);
@@ -886,10 +2727,16 @@ Error: line %zu has only %zu columns, expected %zu", nr, nf, ncol);
 		/* hash dimension columns */
 		with (const uint64_t d = hashln(line, coff)) {
 			if (UNLIKELY(!last_d)) {
-				rset(line, coff);
-			} else if (UNLIKELY(d != last_d)) {
+				rset(&g0, line, coff);
+			} else if (UNLIKELY(d != last_d ||
+					    !lhseq(&g0, line, coff))) {
 				/* materialise cast cols */
-				mtcc();
+				if (UNLIKELY(mtcc() < 0)) {
+					error("\
+Error: cannot sort cast columns");
+					rc = -1;
+					goto err;
+				}
 				/* pretend we didn't see this line */
 				nr--;
 				/* and continue with main tokenisation loop */
@@ -907,7 +2754,7 @@ Error: line %zu has only %zu columns, expected %zu", nr, nf, ncol);
 		with (const uint64_t c = hashrn(line, coff)) {
 			ssize_t j;
 
-			if ((j = find_c(c)) >= 0) {
+			if ((j = find_c(c, line, coff)) >= 0) {
 				/* all good */
 				;
 			} else if (UNLIKELY((j = adcc(line, coff, c)) < 0)) {
@@ -915,13 +2762,42 @@ Error: line %zu has only %zu columns, expected %zu", nr, nf, ncol);
 				goto err;
 			}
 			/* bang */
-			bang(line, coff, j);
+			if (UNLIKELY(bang(&g0, line, coff, j) < 0)) {
+				error("\
+Error: cannot allocate memory for line %zu", nr);
+				rc = -1;
+				goto err;
+			}
 		}
 	}
 
-	mtcc();
-	while ((nrd = getline(&line, &llen, stdin)) > 0) {
+	if (UNLIKELY(mtcc() < 0)) {
+		error("\
+Error: cannot sort cast columns");
+		rc = -1;
+		goto err;
+	}
+	while ((nrd = rdln_getln(&line, rd)) > 0) {
 	tok:
+		if (nthr > 1U) {
+			/* flush the group cast columns were snarfed from */
+			if (cnmp) {
+				/* print col names */
+				phdr(hn, hoff);
+			}
+			cprp = 1;
+			if (!last_d) {
+				;
+			} else if (UNLIKELY(prnt(&g0, ob) < 0)) {
+				rc = -1;
+				goto err;
+			} else {
+				bfls(&g0, ob);
+			}
+			/* and leave the rest to the workers */
+			rc = pll(rd, line, nrd, ncol, coff, nr);
+			goto err;
+		}
 		nr++;
 		size_t nf = tokln1(coff, ncol, line, nrd);
 
@@ -935,16 +2811,19 @@ Error: line %zu has only %zu columns, expected %zu", nr, nf, ncol);
 		/* hash dimension columns */
 		with (const uint64_t d = hashln(line, coff)) {
 			if (UNLIKELY(!last_d)) {
-				rset(line, coff);
-			} else if (UNLIKELY(d != last_d)) {
-				static int cprp;
+				rset(&g0, line, coff);
+			} else if (UNLIKELY(d != last_d ||
+					    !lhseq(&g0, line, coff))) {
 				if (UNLIKELY(!cprp && cnmp)) {
 					/* print col names */
 					phdr(hn, hoff);
 				}
 				cprp = 1;
-				prnt();
-				rset(line, coff);
+				if (UNLIKELY(prnt(&g0, ob) < 0)) {
+					rc = -1;
+					goto err;
+				}
+				rset(&g0, line, coff);
 			}
 			last_d = d;
 		}
@@ -958,23 +2837,40 @@ Error: line %zu has only %zu columns, expected %zu", nr, nf, ncol);
 		with (const uint64_t c = hashrn(line, coff)) {
 			ssize_t j;
 
-			if ((j = find_c(c)) < 0) {
+			if ((j = find_c(c, line, coff)) < 0) {
 				/* don't want him */
 				break;
 			}
 			/* bang */
-			bang(line, coff, j);
+			if (UNLIKELY(bang(&g0, line, coff, j) < 0)) {
+				error("\
+Error: cannot allocate memory for line %zu", nr);
+				rc = -1;
+				goto err;
+			}
 		}
 	}
+	if (UNLIKELY(!cprp && cnmp && last_d)) {
+		/* print col names, just one group it seems */
+		phdr(hn, hoff);
+	}
 	/* print the last one */
-	prnt();
+	if (rc >= 0 && UNLIKELY(prnt(&g0, ob) < 0)) {
+		rc = -1;
+	}
+	bfls(&g0, ob);
 
 err:
+	if (sr != NULL) {
+		rdln_close(sr);
+	}
+	if (sfd >= 0) {
+		close(sfd);
+	}
 	free(coff);
 	free(hoff);
 	free(hn);
 out:
-	free(line);
 	return rc;
 }
 
@@ -985,17 +2881,125 @@ int
 main(int argc, char *argv[])
 {
 	static yuck_t argi[1U];
+	rdln_t rd;
 	int rc = 0;
 
 	if (yuck_parse(argi, argc, argv) < 0) {
 		rc = 1;
 		goto out;
 	}
+	if (UNLIKELY((ob = obuf_open(STDOUT_FILENO)) == NULL)) {
+		error("\
+Error: cannot set up output buffer");
+		rc = 1;
+		goto out;
+	}
 
 	/* overread and/or expect headers? */
 	hdrp = argi->header_flag;
 	/* memorise that we want col names for STCC() later on */
 	cnmp = argi->col_names_flag;
+	if (argi->agg_arg) {
+		static const char *const fns[] = {
+			[AGG_SUM] = "sum",
+			[AGG_MEAN] = "mean",
+			[AGG_MIN] = "min",
+			[AGG_MAX] = "max",
+			[AGG_FIRST] = "first",
+			[AGG_LAST] = "last",
+			[AGG_COUNT] = "count",
+		};
+		for (aggf = AGG_SUM; aggf < countof(fns) &&
+			     strcmp(fns[aggf], argi->agg_arg); aggf++);
+		if (UNLIKELY(aggf >= countof(fns))) {
+			errno = 0, error("\
+Error: unknown aggregation function `%s'", argi->agg_arg);
+			rc = 1;
+			goto out;
+		}
+	}
+	if (argi->jobs_arg) {
+		nthr = strtoul(argi->jobs_arg, NULL, 10) ?: 1U;
+#if !defined HAVE_PTHREAD
+		nthr = 1U;
+#endif	/* !HAVE_PTHREAD */
+	}
+	if (argi->types_arg) {
+		const char *s = argi->types_arg;
+
+		for (const char *p;; s = p + 1U) {
+			typ_t *nu;
+			typ_t t;
+
+			p = memchrnul(s, ',', strlen(s));
+			if (p - s == 4 && !memcmp(s, "auto", 4U)) {
+				/* infer */
+				t = TYP_NIL;
+			} else if (UNLIKELY(!(t = typ_of_name(s, p - s)))) {
+				errno = 0, error("\
+Error: unknown type `%.*s'", (int)(p - s), s);
+				rc = 1;
+				goto out;
+			}
+			if (UNLIKELY((nu = realloc(vtyp, (ntyp + 1U) *
+						   sizeof(*vtyp))) == NULL)) {
+				error("\
+Error: cannot allocate memory for types");
+				rc = 1;
+				goto out;
+			}
+			vtyp = nu;
+			vtyp[ntyp++] = t;
+			if (!*p) {
+				break;
+			}
+		}
+	}
+	if ((binp = argi->binary_flag)) {
+		/* names are part of the stream */
+		cnmp = 1;
+	}
+	dscp = argi->discover_flag;
+	scap = argi->sort_cast_flag;
+	/* input grouped by LHS? */
+	unsp = argi->unsorted_flag;
+	srtp = argi->sort_flag;
+	if (UNLIKELY(binp && unsp && srtp)) {
+		errno = 0, error("\
+Error: --binary cannot be used with --unsorted --sort");
+		rc = 1;
+		goto out;
+	} else if (UNLIKELY(unsp && nthr > 1U)) {
+		errno = 0, error("\
+Error: --jobs cannot be used with --unsorted");
+		rc = 1;
+		goto out;
+	}
+	if (argi->memory_arg) {
+		char *on;
+
+		mmax = strtoull(argi->memory_arg, &on, 10);
+		switch (*on) {
+		case 'G':
+		case 'g':
+			mmax *= 1024U;
+			/*@fallthrough@*/
+		case 'M':
+		case 'm':
+			mmax *= 1024U;
+			/*@fallthrough@*/
+		case 'K':
+		case 'k':
+			mmax *= 1024U;
+		case '\0':
+			break;
+		default:
+			errno = 0, error("\
+Error: cannot interpret memory size `%s'", argi->memory_arg);
+			rc = 1;
+			goto out;
+		}
+	}
 
 	/* snarf formula */
 	if (UNLIKELY(!argi->nargs ||
@@ -1014,24 +3018,48 @@ Error: cannot interpret formula");
 Error: cannot set up cast columns");
 		rc = 1;
 		goto out;
+	} else if (scap && UNLIKELY(srcc() < 0)) {
+		error("\
+Error: cannot sort cast columns");
+		rc = 1;
+		goto out;
+	}
+
+	if (UNLIKELY((rd = rdln_open(STDIN_FILENO)) == NULL)) {
+		error("\
+Error: cannot set up reader for stdin");
+		rc = 1;
+		goto out;
 	}
 
-	rc = proc1() < 0;
+	rc = proc1(rd) < 0;
+	if (btyp != NULL) {
+		/* binary stream has begun */
+		bcol_end(ob);
+	}
+
+	rdln_close(rd);
 
 	/* free cast columns */
 	free(cc);
-	free(nccv);
-	free(zccv);
-	free(zccvo);
-	for (size_t i = 0U; i < ncc; i++) {
-		free(ccv[i]);
-	}
-	free(ccv);
-	for (size_t i = 0U; i < ncc; i++) {
-		free(ccvo[i]);
-	}
-	free(ccvo);
-	free(dim);
+	htab_fini(&ccx);
+	arena_fini(&cka);
+	free(cko);
+	free(ccr);
+	free(ccp);
+	free(vtyp);
+	free(btyp);
+	frgrp(&g0);
+	/* free unsorted mode rows and records */
+	htab_fini(&rwx);
+	arena_fini(&rwk);
+	arena_fini(&rcv);
+	htab_fini(&rcx);
+	free(rca);
+	free(rwko);
+	free(rcr);
+	free(rcc);
+	free(rco);
 	if (!argi->cast_nargs && cn) {
 		for (size_t i = 0U; i < ncc; i++) {
 			free(deconst(cn[i]));
@@ -1047,6 +3075,9 @@ Error: cannot set up cast columns");
 	}
 
 out:
+	if (UNLIKELY(obuf_close(ob) < 0)) {
+		rc = 1;
+	}
 	yuck_free(argi);
 	return rc;
 }
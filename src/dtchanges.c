@@ -43,7 +43,12 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <fcntl.h>
 #include "coru.h"
+#include "tok.h"
+#include "rdln.h"
+#include "obuf.h"
+#include "key.h"
 #include "nifty.h"
 
 struct hs_s {
@@ -54,13 +59,25 @@ struct hs_s {
 
 static int hdrp = 0;
 static int cnmp = 0;
+/* buffered stdout */
+static obuf_t ob;
 static int brfp = 0;
 static const char *form;
+/* file names */
+static char **fn;
+/* whether to merely warn about files not sorted by key */
+static int unsw;
+/* set once a file was found unsorted, both readers stop then */
+static int unsp;
+/* whether readers run on threads of their own */
+static int thrp;
 
 /* join columns in left and right file */
 static struct hs_s jc[2U];
 static struct hs_s xc[2U];
 static struct hs_s vc[2U];
+/* comparators of the join columns */
+static keycmp_t *kc;
 #define L	0U
 #define R	1U
 
@@ -275,37 +292,6 @@ invperm(struct hs_s *restrict tg)
 }
 
 
-static size_t
-toklng(const char *ln, size_t lz)
-{
-	const char *const ep = ln + lz;
-	size_t ncol = 1U;
-
-	for (const char *lp = ln, *np;
-	     (np = memchr(lp, '\t', ep - lp)); lp = np + 1U) {
-		ncol++;
-	}
-	return ncol;
-}
-
-static size_t
-tokln1(size_t *restrict c, size_t nc, const char *ln, size_t lz)
-{
-	const char *const ep = ln + lz;
-	size_t j = 0U;
-
-	lz -= ln[lz - 1] == '\n';
-
-	c[j++] = 0U;
-	for (const char *lp = ln, *np;
-	     j < nc && lp < ep && (np = memchr(lp, '\t', ep - lp));
-	     lp = np + 1U, j++) {
-		c[j] = np + 1U - ln;
-	}
-	c[j] = lz + 1U;
-	return j;
-}
-
 static ssize_t
 find_s(const char *ss, const size_t *of, size_t nc, const char *s, size_t z)
 {
@@ -352,16 +338,19 @@ snrf(struct hs_s *restrict tg,
 	tg->c = calloc(tg->n = nj + 1U, sizeof(*tg->c));
 	/* now try and snarf the whole shebang */
 	for (nj = 0U; nj < tg->n; nj++, j = on + 1U) {
-		const char *om;
+		const char *om, *oe;
 		char *tmp;
 		long unsigned int x;
 		size_t k;
 
 		on = memchrnul(j, '+', ej - j);
+		/* comparator suffixes are kc's business */
+		oe = on;
+		(void)key_sfx(j, &oe);
 		k = 0U;
 		do {
-			om = memchrnul(j, '=', on - j);
-		} while (om < on && k++ < i && (j = om + 1U, true));
+			om = memchrnul(j, '=', oe - j);
+		} while (om < oe && k++ < i && (j = om + 1U, true));
 
 		/* try with numbers first */
 		if ((x = strtoul(j, &tmp, 10)) && eatws(tmp) == om) {
@@ -387,7 +376,7 @@ prnc(const char *base, const size_t *cols, size_t i)
 	if (LIKELY(i < nhof)) {
 		const size_t bo = cols[i + 0U];
 		const size_t eo = cols[i + 1U];
-		fwrite(base + bo, sizeof(*base), eo - bo - 1U, stdout);
+		obuf_add(ob, base + bo, eo - bo - 1U);
 	}
 	return;
 }
@@ -395,32 +384,56 @@ prnc(const char *base, const size_t *cols, size_t i)
 
 struct beef_s {
 	ssize_t nrd;
-	char *line;
+	const char *line;
 	/* intra-line */
 	size_t ncol;
 	size_t *coff;
 	/* line number */
 	size_t nr;
-	/* constant dimension line */
-	size_t ndln;
-	char *dln;
+	/* file the line is from */
+	size_t fibre;
+	/* join columns, encoded */
+	struct key_s key;
 };
 
+static void
+prnk(const struct beef_s *b)
+{
+/* print the join columns of line B */
+	const struct hs_s *j = jc + b->fibre;
+
+	for (size_t i = 0U; i < j->n; i++) {
+		const size_t bo = b->coff[j->c[i] + 0U];
+		const size_t eo = b->coff[j->c[i] + 1U];
+
+		if (i) {
+			obuf_chr(ob, '\t');
+		}
+		obuf_add(ob, b->line + bo, eo - bo - 1U);
+	}
+	return;
+}
+
 DEFCORU(co_proc1, {
-		FILE *fp;
+		rdln_t rd;
 		size_t fibre;
 	}, void *arg)
 {
-	FILE *const fp = CORU_CLOSUR(fp);
+	rdln_t rd = CORU_CLOSUR(rd);
 	size_t fibre = CORU_CLOSUR(fibre);
-	size_t llen = 0U;
-	struct beef_s b = {0U};
-	/* constant dimension line */
-	size_t zdln = 0U;
+	struct beef_s b = {.fibre = fibre};
+	/* key buffers, used alternately to keep the previous key */
+	unsigned char *key[2U] = {NULL, NULL};
+	size_t zkey[2U] = {0U, 0U};
+	struct key_s pk = {0U};
+	/* lines out of order */
+	size_t nuns = 0U;
+	/* whether lines outlive the next read */
+	const int stblp = rdln_stablep(rd);
 	int rc = 0;
 
 	/* probe */
-	if (UNLIKELY((b.nrd = getline(&b.line, &llen, fp)) < 0)) {
+	if (UNLIKELY((b.nrd = rdln_getln(&b.line, rd)) < 0)) {
 		error("\
 Error: cannot read lines");
 		rc = -1;
@@ -482,11 +495,12 @@ Error: fewer columns present than needed for formula");
 		goto tok;
 	}
 
-	while ((b.nrd = getline(&b.line, &llen, fp)) > 0) {
+	while ((b.nrd = rdln_getln(&b.line, rd)) > 0) {
 		size_t bo, eo;
 	tok:
 		b.nr++;
 		size_t nf = tokln1(b.coff, b.ncol, b.line, b.nrd);
+		const size_t w = b.nr & 1U;
 
 		if (UNLIKELY(nf < b.ncol)) {
 			errno = 0, error("\
@@ -495,51 +509,101 @@ Error: line %zu has only %zu columns, expected %zu", b.nr, nf, b.ncol);
 			break;
 		}
 
-		/* construct constant dimension prefix */
-		b.ndln = 0U;
+		/* encode the join columns */
+		b.key.z = 0U;
 		for (size_t i = 0U; i < jc[L].n; i++) {
 			bo = b.coff[jc[fibre].c[i] + 0U];
 			eo = b.coff[jc[fibre].c[i] + 1U];
 
-			if (UNLIKELY(b.ndln + eo - bo > zdln)) {
+			if (UNLIKELY(b.key.z + KEY_ENCZ(eo - bo) > zkey[w])) {
 				/* resize */
-				while ((zdln = (zdln * 2U) ?: 256U) <=
-				       b.ndln + eo - bo);
-				b.dln = realloc(b.dln, zdln * sizeof(*b.dln));
+				while ((zkey[w] = (zkey[w] * 2U) ?: 256U) <
+				       b.key.z + KEY_ENCZ(eo - bo));
+				key[w] = realloc(key[w], zkey[w]);
+				if (UNLIKELY(key[w] == NULL)) {
+					error("\
+Error: cannot allocate memory to hold the key of line %zu", b.nr);
+					rc = -1;
+					goto out;
+				}
+			}
+			b.key.z += key_enc(key[w] + b.key.z, kc[i],
+					   b.line + bo, eo - bo - 1U);
+		}
+		b.key.k = key[w];
+		b.key.pfx = key_pfx(key[w], b.key.z);
+
+		/* keys mustn't decrease */
+		if (LIKELY(b.nr <= 1U || key_cmp(&pk, &b.key) <= 0)) {
+			;
+		} else if (unsw) {
+			if (!nuns++) {
+				errno = 0, error("\
+Warning: line %zu of `%s' is out of order", b.nr + hdrp, fn[fibre]);
 			}
-			memcpy(b.dln + b.ndln, b.line + bo, eo - bo - 1);
-			b.ndln += eo - bo - 1;
-			b.dln[b.ndln++] = '\t';
+		} else {
+			errno = 0, error("\
+Error: line %zu of `%s' is out of order", b.nr + hdrp, fn[fibre]);
+			__atomic_store_n(&unsp, 1, __ATOMIC_RELAXED);
+			rc = -1;
+			break;
 		}
-		/* terminate dln */
-		b.ndln -= !!jc[L].n;
-		b.dln[b.ndln] = '\0';
+		pk = b.key;
 
 		/* prep yield */
 		*(struct beef_s*)arg = b;
-		if (YIELD(1) < 0) {
+		if (THREADP(ctx->next)) {
+			/* the coordinator sees this line only after we've
+			 * moved on, so offsets, key and, if need be, the line
+			 * itself must go along */
+			struct beef_s *y = arg;
+			const size_t zo = (b.ncol + 1U) * sizeof(*b.coff);
+			const size_t zl = stblp ? 0U : (size_t)b.nrd;
+			char *p = YALLOC(zo + b.key.z + zl);
+
+			if (UNLIKELY(p == NULL)) {
+				error("\
+Error: cannot allocate memory to hand over line %zu", b.nr);
+				rc = -1;
+				break;
+			}
+			y->coff = memcpy(p, b.coff, zo);
+			y->key.k = memcpy(p + zo, b.key.k, b.key.z);
+			if (zl) {
+				y->line = memcpy(p + zo + b.key.z, b.line, zl);
+			}
+		}
+		if (YIELD(1) < 0 ||
+		    UNLIKELY(__atomic_load_n(&unsp, __ATOMIC_RELAXED))) {
 			break;
 		}
 	}
-out:
-	if (jc[fibre].n) {
-		free(jc[fibre].c);
-		free(jc[fibre].p);
-	}
-	if (xc[fibre].n) {
-		free(xc[fibre].c);
-		free(xc[fibre].p);
-	}
-	if (vc[fibre].n) {
-		free(vc[fibre].c);
-		free(vc[fibre].p);
+	if (UNLIKELY(nuns > 1U)) {
+		errno = 0, error("\
+Warning: %zu lines of `%s' are out of order", nuns, fn[fibre]);
 	}
+out:
 	free(b.coff);
-	free(b.dln);
-	free(b.line);
+	free(key[0U]);
+	free(key[1U]);
 	return rc;
 }
 
+static struct cocore*
+strt(struct cocore *self, rdln_t rd, size_t fibre)
+{
+/* start reading RD as FIBRE, on a thread of its own if asked to */
+	struct cocore *c;
+
+	if (thrp &&
+	    (c = START_THREAD_PACK(co_proc1, sizeof(struct beef_s),
+				   .clo = {.rd = rd, .fibre = fibre}))) {
+		return c;
+	}
+	return START_PACK(co_proc1, .next = self,
+			  .clo = {.rd = rd, .fibre = fibre});
+}
+
 static void
 prnt(const struct beef_s *x, const struct beef_s *y)
 {
@@ -574,60 +638,58 @@ prnt(const struct beef_s *x, const struct beef_s *y)
 		}
 		return;
 	pr:
-		fputc(' ', stdout);
-		fwrite(y->dln, 1, y->ndln, stdout);
+		obuf_chr(ob, ' ');
+		prnk(y);
 		for (size_t i = jc->n; i < nhof; i++) {
-			fputc('\t', stdout);
+			obuf_chr(ob, '\t');
 			switch (z[i]) {
 			case 0U:
 			default:
 				continue;
 			case 1U:
-				fputc('-', stdout);
+				obuf_chr(ob, '-');
 				prnc(x->line, x->coff, vc[L].p[i]);
 				continue;
 			case 2U:
-				fputc('+', stdout);
+				obuf_chr(ob, '+');
 				prnc(y->line, y->coff, vc[R].p[i]);
 				continue;
 			case 3U:
 				break;
 			}
 			prnc(x->line, x->coff, vc[L].p[i]);
-			fwrite(" => ", 1, 4U, stdout);
+			obuf_add(ob, " => ", 4U);
 			prnc(y->line, y->coff, vc[R].p[i]);
 		}
 	} else if (x) {
-		fputc('-', stdout);
-		fwrite(x->dln, 1, x->ndln, stdout);
+		obuf_chr(ob, '-');
+		prnk(x);
 		for (size_t i = jc[L].n; i < nhof; i++) {
-			fputc('\t', stdout);
+			obuf_chr(ob, '\t');
 			prnc(x->line, x->coff, vc[L].p[i]);
 		}
 	} else if (y) {
-		fputc('+', stdout);
-		fwrite(y->dln, 1, y->ndln, stdout);
+		obuf_chr(ob, '+');
+		prnk(y);
 		for (size_t i = jc[R].n; i < nhof; i++) {
-			fputc('\t', stdout);
+			obuf_chr(ob, '\t');
 			prnc(y->line, y->coff, vc[R].p[i]);
 		}
 	} else {
 		return;
 	}
-	fputc('\n', stdout);
+	obuf_chr(ob, '\n');
 	return;
 }
 
 static int
-proc(FILE *fpx, FILE *fpy)
+proc(rdln_t rx, rdln_t ry)
 {
-/* coordinator between fpx and fpy */
+/* coordinator between rx and ry */
 	int rc = 0;
 	struct cocore *self = PREP();
-	struct cocore *px = START_PACK(co_proc1, .next = self,
-				       .clo = {.fp = fpx, .fibre = 0U});
-	struct cocore *py = START_PACK(co_proc1, .next = self,
-				       .clo = {.fp = fpy, .fibre = 1U});
+	struct cocore *px = strt(self, rx, 0U);
+	struct cocore *py = strt(self, ry, 1U);
 	struct beef_s bx;
 	struct beef_s by;
 	int sx = NEXT1(px, &bx);
@@ -635,7 +697,7 @@ proc(FILE *fpx, FILE *fpy)
 
 	if (cnmp && sx > 0 && sy > 0) {
 		hdr[nhdr - 1U] = '\n';
-		fwrite(hdr + 1U, sizeof(*hdr), nhdr - 1U, stdout);
+		obuf_add(ob, hdr + 1U, nhdr - 1U);
 	}
 
 	if (sx > 0 && sy > 0) {
@@ -647,7 +709,7 @@ proc(FILE *fpx, FILE *fpy)
 	     sx = NEXT1(px, &bx), sy = NEXT1(py, &by)) {
 		if (sx > 0 && sy > 0) {
 		redo:
-			c = strcmp(bx.dln, by.dln);
+			c = key_cmp(&bx.key, &by.key);
 
 			if (0) {
 				;
@@ -691,6 +753,8 @@ proc(FILE *fpx, FILE *fpy)
 			break;
 		}
 	}
+	STOP(px);
+	STOP(py);
 	UNPREP();
 	return rc;
 }
@@ -735,14 +799,12 @@ pr:
 }
 
 static int
-summ(FILE *fpx, FILE *fpy)
+summ(rdln_t rx, rdln_t ry)
 {
-/* coordinator between fpx and fpy */
+/* coordinator between rx and ry */
 	struct cocore *self = PREP();
-	struct cocore *px = START_PACK(co_proc1, .next = self,
-				       .clo = {.fp = fpx, .fibre = 0U});
-	struct cocore *py = START_PACK(co_proc1, .next = self,
-				       .clo = {.fp = fpy, .fibre = 1U});
+	struct cocore *px = strt(self, rx, 0U);
+	struct cocore *py = strt(self, ry, 1U);
 	struct beef_s bx;
 	struct beef_s by;
 	int sx = NEXT1(px, &bx);
@@ -760,7 +822,7 @@ summ(FILE *fpx, FILE *fpy)
 	     sx = NEXT1(px, &bx), sy = NEXT1(py, &by)) {
 		if (sx > 0 && sy > 0) {
 		redo:
-			c = strcmp(bx.dln, by.dln);
+			c = key_cmp(&bx.key, &by.key);
 
 			if (0) {
 				;
@@ -803,23 +865,28 @@ summ(FILE *fpx, FILE *fpy)
 			break;
 		}
 	}
+	STOP(px);
+	STOP(py);
 	UNPREP();
 
-	if (!brfp) {
-		printf("%zu line(s) added\n", nl[ADD]);
-		printf("%zu line(s) removed\n", nl[DEL]);
-		printf("%zu line(s) changed\n", nl[CHG]);
-		printf("  %zu value(s) added\n", nc[ADD]);
-		printf("  %zu value(s) removed\n", nc[DEL]);
-		printf("  %zu value(s) changed\n", nc[CHG]);
+	if (UNLIKELY(unsp)) {
+		/* counts are meaningless */
+		return -1;
+	} else if (!brfp) {
+		obuf_fmt(ob, "%zu line(s) added\n", nl[ADD]);
+		obuf_fmt(ob, "%zu line(s) removed\n", nl[DEL]);
+		obuf_fmt(ob, "%zu line(s) changed\n", nl[CHG]);
+		obuf_fmt(ob, "  %zu value(s) added\n", nc[ADD]);
+		obuf_fmt(ob, "  %zu value(s) removed\n", nc[DEL]);
+		obuf_fmt(ob, "  %zu value(s) changed\n", nc[CHG]);
 	} else {
 		for (size_t i = 0U; i < NCHGTYP; i++) {
-			fprintf(stdout, "%zu", nl[i]);
-			fputc('\t', stdout);
+			obuf_fmt(ob, "%zu", nl[i]);
+			obuf_chr(ob, '\t');
 		}
 		for (size_t i = 0U; i < NCHGTYP; i++) {
-			fprintf(stdout, "%zu", nc[i]);
-			fputc('\t' + (i == CHG), stdout);
+			obuf_fmt(ob, "%zu", nc[i]);
+			obuf_chr(ob, '\t' + (i == CHG));
 		}
 	}
 	return rc;
@@ -832,31 +899,55 @@ int
 main(int argc, char *argv[])
 {
 	static yuck_t argi[1U];
-	static FILE *fpx;
-	static FILE *fpy;
+	static int fdx = -1;
+	static int fdy = -1;
+	static rdln_t rx;
+	static rdln_t ry;
 	int rc = 0;
 
 	if (yuck_parse(argi, argc, argv) < 0) {
 		rc = 1;
 		goto out;
 	}
+	if (UNLIKELY((ob = obuf_open(STDOUT_FILENO)) == NULL)) {
+		error("\
+Error: cannot set up output buffer");
+		rc = 1;
+		goto out;
+	}
 
 	/* overread and/or expect headers? */
 	hdrp = argi->header_flag;
 	/* memorise that we want col names for STCC() later on */
 	cnmp = argi->col_names_flag;
+	fn = argi->args;
+	/* readers on threads, if they can be had */
+	thrp = argi->threads_flag;
+
+	if (!argi->unsorted_arg || !strcmp(argi->unsorted_arg, "error")) {
+		unsw = 0;
+	} else if (!strcmp(argi->unsorted_arg, "warn")) {
+		unsw = 1;
+	} else {
+		errno = 0, error("\
+Error: --unsorted must be error or warn");
+		rc = 1;
+		goto out;
+	}
 
 	if (argi->nargs < 3U) {
 		errno = 0, error("\
 Error: need two files and a formula");
 		rc = 1;
 		goto out;
-	} else if (UNLIKELY(!(fpx = fopen(argi->args[0U], "r")))) {
+	} else if (UNLIKELY((fdx = open(argi->args[0U], O_RDONLY)) < 0 ||
+			    (rx = rdln_open(fdx)) == NULL)) {
 		error("\
 Error: cannot open `%s' for reading", argi->args[0U]);
 		rc = 1;
 		goto clo;
-	} else if (UNLIKELY(!(fpy = fopen(argi->args[1U], "r")))) {
+	} else if (UNLIKELY((fdy = open(argi->args[1U], O_RDONLY)) < 0 ||
+			    (ry = rdln_open(fdy)) == NULL)) {
 		error("\
 Error: cannot open `%s' for reading", argi->args[1U]);
 		rc = 1;
@@ -864,6 +955,14 @@ Error: cannot open `%s' for reading", argi->args[1U]);
 	}
 	/* keep track of the formula */
 	form = argi->args[2U];
+	with (const char *lhs = form + strcspn(form, "~")) {
+		if (UNLIKELY((kc = key_form(form, lhs - form)) == NULL)) {
+			error("\
+Error: cannot allocate memory for the formula");
+			rc = 1;
+			goto clo;
+		}
+	}
 
 	/* prealloc some header space */
 	if (UNLIKELY((hdr = malloc(zhdr = 256U)) == NULL)) {
@@ -886,23 +985,46 @@ Error: cannot allocate space for header");
 	initialise_cocore();
 
 	if (!argi->summary_arg) {
-		rc = proc(fpx, fpy) < 0;
+		rc = proc(rx, ry) < 0;
 	} else {
 		brfp = argi->summary_arg != YUCK_OPTARG_NONE;
-		rc = summ(fpx, fpy) < 0;
+		rc = summ(rx, ry) < 0;
+	}
+	rc = rc || unsp;
+
+	/* lines seen by the coordinators may outlive their readers,
+	 * so columns are freed only now */
+	for (size_t i = 0U; i < countof(jc); i++) {
+		if (jc[i].n) {
+			free(jc[i].c);
+			free(jc[i].p);
+		}
+		if (xc[i].n) {
+			free(xc[i].c);
+			free(xc[i].p);
+		}
+		if (vc[i].n) {
+			free(vc[i].c);
+			free(vc[i].p);
+		}
 	}
-
 	free(hdr);
 	free(hof);
+	free(kc);
 
 clo:
-	if (fpx) {
-		fclose(fpx);
+	rdln_close(rx);
+	if (fdx >= 0) {
+		close(fdx);
 	}
-	if (fpy) {
-		fclose(fpy);
+	rdln_close(ry);
+	if (fdy >= 0) {
+		close(fdy);
 	}
 out:
+	if (UNLIKELY(obuf_close(ob) < 0)) {
+		rc = 1;
+	}
 	yuck_free(argi);
 	return rc;
 }
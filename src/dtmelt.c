@@ -43,6 +43,14 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <math.h>
+#include <regex.h>
+#include "tok.h"
+#include "rdln.h"
+#include "obuf.h"
+#include "typ.h"
+#include "bcol.h"
+#include "ppln.h"
 #include "nifty.h"
 
 /* special value for ... on RHS */
@@ -50,13 +58,62 @@
 
 static int hdrp = 0;
 static int cnmp = 0;
+/* buffered stdout */
+static obuf_t ob;
 
 /* idvars (our left hand side) */
 static size_t nlhs;
 static size_t *lhs;
-/* measure vars (our right hand side) */
+/* measure vars (our right hand side), in rows of NVAL values,
+ * NVAL is more than one for patterns(RX1,RX2,...) only */
 static size_t nrhs;
 static size_t *rhs;
+static size_t nval = 1U;
+/* type of the value column, TYP_NIL to infer it */
+static typ_t vtyp = TYP_STR;
+/* binary columnar output, NBC columns of types BTYP */
+static int binp;
+static typ_t *btyp;
+static size_t nbc;
+/* measure var names (or row indices for patterns), each followed by
+ * a tab, row J's spans [HDO[J], HDO[J + 1U]) of HDT */
+static char *hdt;
+static size_t *hdo;
+/* number of variable columns, more than one for product headers */
+static size_t nvar = 1U;
+/* id vars are adjacent columns, none of them the last one */
+static int adjp;
+/* number of worker threads */
+static size_t nthr = 1U;
+/* drop rows whose value is missing */
+static int narm;
+/* keep only rows whose value matches VRX or lies in [VLO, VHI],
+ * the range being numbers or dates as per RTYP */
+static enum {
+	WHR_NONE,
+	WHR_RX,
+	WHR_RNG,
+} whr;
+static regex_t vrx;
+static typ_t rtyp;
+static double vlo = -HUGE_VAL;
+static double vhi = HUGE_VAL;
+/* any of the above */
+static int fltp;
+
+/* melt state, one per worker */
+struct mlt_s {
+	size_t ncol;
+	size_t *coff;
+	/* buffer of the constant dimension prefix */
+	size_t zdln;
+	char *dln;
+	/* rows for binary output */
+	bcol_t bc;
+	/* value as string, for regexec() */
+	size_t zvb;
+	char *vb;
+};
 
 
 static void
@@ -125,24 +182,74 @@ chck(size_t ncol)
 }
 
 static void
-phdr(const char *hdrs, const size_t *hoff, size_t nxph)
+thdr(obuf_t o, const char *hdrs, const size_t *hoff, size_t nxph)
 {
 	for (size_t i, j = 0U; j < nlhs; j++) {
 		i = lhs[j];
 		const size_t of = hoff[i + 0U];
 		const size_t eo = hoff[i + 1U];
-		fwrite(hdrs + of, sizeof(*hdrs), eo - of - 1U, stdout);
-		fputc('\t' + (!nrhs && j + 1U >= nlhs), stdout);
+		obuf_add(o, hdrs + of, eo - of - 1U);
+		obuf_chr(o, '\t' + (!nrhs && j + 1U >= nlhs));
 	}
 	if (!nrhs) {
 		return;
 	} else if (nxph <= 1U) {
-		fputs("variable\t", stdout);
+		obuf_str(o, "variable\t");
 	} else for (size_t j = 0U; j < nxph; j++) {
-		fprintf(stdout, "variable%zu", j + 1U);
-		fputc('\t', stdout);
+		obuf_fmt(o, "variable%zu", j + 1U);
+		obuf_chr(o, '\t');
+	}
+	if (nval <= 1U) {
+		obuf_str(o, "value\n");
+	} else for (size_t j = 0U; j < nval; j++) {
+		obuf_fmt(o, "value%zu", j + 1U);
+		obuf_chr(o, '\t' + (j + 1U >= nval));
+	}
+	return;
+}
+
+static int
+bhdr(const char *hdrs, const size_t *hoff, size_t nxph)
+{
+/* print the header of the binary stream, column names as per thdr() */
+	const char *h, *eh;
+	obuf_t o;
+	size_t z;
+
+	nbc = nlhs + (nrhs ? (nxph ?: 1U) + nval : 0U);
+	if (UNLIKELY((btyp = malloc(nbc * sizeof(*btyp))) == NULL)) {
+		return -1;
+	} else if (UNLIKELY((o = obuf_open(-1)) == NULL)) {
+		return -1;
+	}
+	for (size_t i = 0U; i < nbc; i++) {
+		btyp[i] = TYP_STR;
+	}
+	for (size_t i = nrhs ? nbc - nval : nbc; i < nbc; i++) {
+		btyp[i] = vtyp;
+	}
+	thdr(o, hdrs, hoff, nxph);
+	h = obuf_data(o, &z);
+	eh = h + z - 1U;
+	bcol_hdr(ob, nbc);
+	for (size_t i = 0U; i < nbc; i++) {
+		const char *p = memchrnul(h, '\t', eh - h);
+
+		bcol_name(ob, btyp[i], h, p - h);
+		h = p + (p < eh);
+	}
+	return obuf_close(o);
+}
+
+static void
+phdr(const char *hdrs, const size_t *hoff, size_t nxph)
+{
+	if (!binp) {
+		thdr(ob, hdrs, hoff, nxph);
+	} else if (UNLIKELY(bhdr(hdrs, hoff, nxph) < 0)) {
+		error("\
+Error: cannot print header of binary output");
 	}
-	fputs("value\n", stdout);
 	return;
 }
 
@@ -152,7 +259,7 @@ cxph(char *restrict hn, const size_t *of)
 /* check if we're dealing with headers from a cross-product (A*B) */
 	size_t n = 0U;
 
-	if (UNLIKELY(rhs == NULL)) {
+	if (UNLIKELY(rhs == NULL) || nval > 1U) {
 		return 1U;
 	}
 	with (size_t i = rhs[0U]) {
@@ -203,37 +310,6 @@ mkhdrs(size_t *restrict of, size_t nc)
 }
 
 
-static size_t
-toklng(const char *ln, size_t lz)
-{
-	const char *const ep = ln + lz;
-	size_t ncol = 1U;
-
-	for (const char *lp = ln, *np;
-	     (np = memchr(lp, '\t', ep - lp)); lp = np + 1U) {
-		ncol++;
-	}
-	return ncol;
-}
-
-static size_t
-tokln1(size_t *restrict c, size_t nc, const char *ln, size_t lz)
-{
-	const char *const ep = ln + lz;
-	size_t j = 0U;
-
-	lz -= ln[lz - 1] == '\n';
-
-	c[j++] = 0U;
-	for (const char *lp = ln, *np;
-	     j < nc && lp < ep && (np = memchr(lp, '\t', ep - lp));
-	     lp = np + 1U, j++) {
-		c[j] = np + 1U - ln;
-	}
-	c[j] = lz + 1U;
-	return j;
-}
-
 static ssize_t
 find_s(const char *ss, const size_t *of, size_t nc, const char *s, size_t z)
 {
@@ -250,6 +326,87 @@ find_s(const char *ss, const size_t *of, size_t nc, const char *s, size_t z)
 	return -1;
 }
 
+static int
+snpt(const char *r, const char *erhs, const char *hn, const size_t *of,
+     size_t nc)
+{
+/* snarf patterns(RX1,RX2,...) in R to ERHS into a gather plan,
+ * columns matching RXk (in header order) become the k-th values */
+	size_t np = 1U;
+	int rc = 0;
+
+	for (const char *on = r; (on = memchr(on, ',', erhs - on)); np++, on++);
+	if (UNLIKELY(hn == NULL)) {
+		/* retry when we've got the header */
+		return -1;
+	}
+
+	regex_t rx[np];
+	size_t cnt[np];
+	/* the pattern each column matched, NP for none */
+	size_t grp[nc];
+
+	for (size_t k = 0U; k < np; k++, r++) {
+		const char *on = memchrnul(r, ',', erhs - r);
+		char *x = strndup(r, on - r);
+
+		if (UNLIKELY(x == NULL ||
+			     regcomp(rx + k, x, REG_EXTENDED | REG_NOSUB))) {
+			free(x);
+			np = k;
+			rc = -1;
+			goto out;
+		}
+		free(x);
+		cnt[k] = 0U;
+		r = on;
+	}
+	for (size_t i = 0U; i < nc; i++) {
+		grp[i] = np;
+		for (size_t j = 0U; j < nlhs; j++) {
+			if (i == lhs[j]) {
+				/* id vars aren't measures */
+				goto next;
+			}
+		}
+		for (size_t k = 0U; k < np; k++) {
+			if (!regexec(rx + k, hn + of[i], 0U, NULL, 0)) {
+				cnt[grp[i] = k]++;
+				break;
+			}
+		}
+	next:
+		continue;
+	}
+	for (size_t k = 0U; k < np; k++) {
+		if (UNLIKELY(!cnt[k] || cnt[k] != cnt[0U])) {
+			errno = 0, error("\
+Error: patterns must match the same number of columns");
+			rc = -1;
+			goto out;
+		}
+	}
+	/* lay out the plan, row J's K-th value is column RHS[J * NP + K] */
+	nrhs = cnt[0U] * np;
+	if (UNLIKELY((rhs = calloc(nrhs, sizeof(*rhs))) == NULL)) {
+		rc = -1;
+		goto out;
+	}
+	nval = np;
+	for (size_t i = nc; i-- > 0U;) {
+		if (grp[i] < np) {
+			const size_t k = grp[i];
+
+			rhs[--cnt[k] * np + k] = i;
+		}
+	}
+out:
+	for (size_t k = 0U; k < np; k++) {
+		regfree(rx + k);
+	}
+	return rc;
+}
+
 static int
 snrf(const char *formula, const char *hn, const size_t *of, size_t nc)
 {
@@ -308,6 +465,11 @@ rhs:
 	if (!nr && !memcmp(r, "...\0", 4U)) {
 		rhs = rhs ?: ELLIPSIS;
 		goto fin;
+	} else if (!strncmp(r, "patterns(", 9U) && erhs[-1] == ')') {
+		if (rhs == NULL && snpt(r + 9U, erhs - 1U, hn, of, nc) < 0) {
+			return -1;
+		}
+		goto fin;
 	} else if (r == erhs) {
 		/* no right side */
 		goto fin;
@@ -341,13 +503,524 @@ fin:
 	form = NULL;
 	return 0;
 }
+/* lines to infer the value type from */
+#define NINF	(1024U)
+
+static size_t
+infr(const char *s, size_t z, size_t ncol, size_t *coff)
+{
+/* join into VTYP the types of the measure vars of the complete lines
+ * in S of size Z, return the number of lines looked at */
+	size_t n = 0U;
+
+	for (const char *eol; n < NINF &&
+		     (eol = memchr(s, '\n', z)) != NULL; n++) {
+		const size_t lz = eol + 1U - s;
+
+		if (tokln1(coff, ncol, s, lz) >= ncol) {
+			for (size_t i = 0U; i < nrhs; i++) {
+				const size_t bo = coff[rhs[i] + 0U];
+				const size_t eo = coff[rhs[i] + 1U];
+				const typ_t x = typ_guess(s + bo, eo - bo - 1U);
+
+				vtyp = typ_join(vtyp, x);
+			}
+		}
+		s += lz;
+		z -= lz;
+	}
+	return n;
+}
+
+static void
+stty(rdln_t rd, const char *line, size_t nrd, size_t ncol, size_t *coff)
+{
+/* infer the value type from LINE (if any) and the lines buffered
+ * after it */
+	const char *p;
+	size_t n = 0U;
+	size_t z;
+
+	if (vtyp != TYP_NIL) {
+		return;
+	}
+	if (line != NULL) {
+		n = infr(line, nrd, ncol, coff);
+	}
+	z = rdln_peek(&p, rd);
+	if (n < NINF) {
+		(void)infr(p, z, ncol, coff);
+	}
+	if (vtyp == TYP_NIL) {
+		vtyp = TYP_STR;
+	}
+	return;
+}
 
 static int
-proc1(void)
+mkhd(const char *hn, const size_t *hoff, size_t ncol, size_t nxph)
+{
+/* set up the measure var spans and check the id vars for adjacency */
+	const size_t nrow = nrhs / nval;
+	size_t n = 0U;
+
+	if (UNLIKELY((hdo = malloc((nrow + 1U) * sizeof(*hdo))) == NULL)) {
+		return -1;
+	}
+	for (size_t j = 0U; j < nrhs; j++) {
+		n += hoff[rhs[j] + 1U] - hoff[rhs[j]];
+	}
+	if (nval > 1U) {
+		/* rows are enumerated instead */
+		n = nrow * 21U;
+	}
+	if (UNLIKELY((hdt = malloc(n + 1U)) == NULL)) {
+		return -1;
+	}
+	n = 0U;
+	for (size_t j = 0U; nval > 1U && j < nrow; j++) {
+		hdo[j] = n;
+		n += sprintf(hdt + n, "%zu\t", j + 1U);
+	}
+	for (size_t j = 0U; nval <= 1U && j < nrhs; j++) {
+		const size_t hb = hoff[rhs[j] + 0U];
+		const size_t he = hoff[rhs[j] + 1U];
+
+		hdo[j] = n;
+		memcpy(hdt + n, hn + hb, he - hb - 1U);
+		n += he - hb - 1U;
+		hdt[n++] = '\t';
+	}
+	hdo[nrow] = n;
+	nvar = nxph ?: 1U;
+
+	adjp = nlhs && nrhs && lhs[nlhs - 1U] + 1U < ncol;
+	for (size_t i = 1U; adjp && i < nlhs; i++) {
+		adjp = lhs[i] == lhs[i - 1U] + 1U;
+	}
+	return 0;
+}
+
+static void
+pval(obuf_t o, const char *v, size_t z)
+{
+/* output value V of size Z as per VTYP */
+	char buf[TYP_FMTZ];
+	typv_t x;
+
+	if (vtyp == TYP_STR) {
+		obuf_add(o, v, z);
+		return;
+	}
+	(void)typ_parse(&x, vtyp, v, z);
+	obuf_add(o, buf, typ_fmt(buf, vtyp, x));
+	return;
+}
+
+static int
+vrx1(struct mlt_s *restrict m, const char *v, size_t z)
+{
+/* whether V of size Z matches VRX */
+	if (UNLIKELY(z >= m->zvb)) {
+		while ((m->zvb = (m->zvb * 2U) ?: 256U) <= z);
+		if (UNLIKELY((m->vb = realloc(m->vb, m->zvb)) == NULL)) {
+			m->zvb = 0U;
+			return 0;
+		}
+	}
+	memcpy(m->vb, v, z);
+	m->vb[z] = '\0';
+	return !regexec(&vrx, m->vb, 0U, NULL, 0);
+}
+
+static int
+vokp(struct mlt_s *restrict m, const char *v, size_t z)
+{
+/* whether to output a row with value V of size Z,
+ * as per --na-rm and --where-value */
+	typv_t x;
+	int na;
+
+	if (vtyp == TYP_STR) {
+		na = !z;
+	} else {
+		na = typ_parse(&x, vtyp, v, z) < 0;
+	}
+	if (na && narm) {
+		return 0;
+	}
+	switch (whr) {
+	case WHR_RX:
+		return vrx1(m, v, z);
+	case WHR_RNG:
+		if (vtyp != rtyp) {
+			na = typ_parse(&x, rtyp, v, z) < 0;
+		}
+		if (na) {
+			return 0;
+		} else with (const double d = rtyp == TYP_DATE ? x.t : x.d) {
+			return d >= vlo && d <= vhi;
+		}
+	default:
+		break;
+	}
+	return 1;
+}
+
+static int
+rokp(struct mlt_s *restrict m, const char *line, const size_t *gth)
+{
+/* whether to output the row of values in columns GTH[0, NVAL),
+ * i.e. whether any of them passes */
+	const size_t *const coff = m->coff;
+
+	for (size_t k = 0U; k < nval; k++) {
+		const size_t bo = coff[gth[k] + 0U];
+		const size_t eo = coff[gth[k] + 1U];
+
+		if (vokp(m, line + bo, eo - bo - 1U)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void
+bfld(bcol_t b, size_t i, const char *s, size_t z)
+{
+/* add S of size Z, fields tab separated, to columns I onwards */
+	for (;; i++) {
+		const char *const p = memchrnul(s, '\t', z);
+
+		bcol_add(b, i, s, p - s);
+		if (p >= s + z) {
+			break;
+		}
+		z -= p + 1U - s;
+		s = p + 1U;
+	}
+	return;
+}
+
+static void
+mltb(struct mlt_s *restrict m, obuf_t o, const char *line)
+{
+/* melt tokenised LINE into M's binary rows, a row per measure var
+ * (or row of the gather plan), or just the id vars */
+	const size_t *const coff = m->coff;
+
+	if (UNLIKELY(m->bc == NULL) &&
+	    UNLIKELY((m->bc = bcol_open(nbc, btyp)) == NULL)) {
+		error("\
+Error: cannot set up binary output");
+		return;
+	}
+	for (size_t r = 0U, j = 0U; !r || j < nrhs; r++, j += nval) {
+		if (nrhs && fltp && !rokp(m, line, rhs + j)) {
+			continue;
+		}
+		for (size_t i = 0U; i < nlhs; i++) {
+			const size_t bo = coff[lhs[i] + 0U];
+			const size_t eo = coff[lhs[i] + 1U];
+
+			bcol_add(m->bc, i, line + bo, eo - bo - 1U);
+		}
+		if (nrhs) {
+			const size_t hb = hdo[r + 0U];
+			const size_t he = hdo[r + 1U];
+
+			bfld(m->bc, nlhs, hdt + hb, he - hb - 1U);
+		}
+		for (size_t k = 0U; nrhs && k < nval; k++) {
+			const size_t bo = coff[rhs[j + k] + 0U];
+			const size_t eo = coff[rhs[j + k] + 1U];
+			const size_t i = nlhs + nvar + k;
+
+			bcol_add(m->bc, i, line + bo, eo - bo - 1U);
+		}
+		if (bcol_row(m->bc)) {
+			bcol_flush(m->bc, o);
+		}
+	}
+	return;
+}
+
+static size_t
+mlt1(struct mlt_s *restrict m, obuf_t o, const char *line, size_t nrd)
+{
+/* melt LINE of size NRD into O, return the number of columns found,
+ * nothing is output if there are fewer than expected */
+	const size_t *const coff = m->coff;
+	const size_t nf = tokln1(m->coff, m->ncol, line, nrd);
+	const char *dp;
+	size_t ndln;
+
+	if (UNLIKELY(nf < m->ncol)) {
+		return nf;
+	} else if (binp) {
+		mltb(m, o, line);
+		return nf;
+	} else if (adjp) {
+		/* the dimension prefix is right there in the line */
+		dp = line + coff[lhs[0U]];
+		ndln = coff[lhs[nlhs - 1U] + 1U] - coff[lhs[0U]];
+		goto pre;
+	}
+	/* construct constant dimension prefix */
+	ndln = 0U;
+	for (size_t i = 0U; i < nlhs; i++) {
+		const size_t bo = coff[lhs[i] + 0U];
+		const size_t eo = coff[lhs[i] + 1U];
+
+		if (UNLIKELY(ndln + eo - bo > m->zdln)) {
+			/* resize */
+			while ((m->zdln = (m->zdln * 2U) ?: 256U) <=
+			       ndln + eo - bo);
+			m->dln = realloc(m->dln, m->zdln * sizeof(*m->dln));
+		}
+		memcpy(m->dln + ndln, line + bo, eo - bo - 1);
+		ndln += eo - bo - 1;
+		m->dln[ndln++] = '\t';
+	}
+
+	if (UNLIKELY(!nrhs)) {
+		/* last tab to newline */
+		m->dln[ndln - 1U]++;
+		obuf_add(o, m->dln, ndln);
+		return nf;
+	}
+	dp = m->dln;
+pre:
+	for (size_t r = 0U, j = 0U; j < nrhs; r++, j += nval) {
+		if (fltp && !rokp(m, line, rhs + j)) {
+			continue;
+		}
+		obuf_add(o, dp, ndln);
+		/* header or index, and a tab */
+		obuf_add(o, hdt + hdo[r], hdo[r + 1U] - hdo[r]);
+		/* gather the row's values */
+		for (size_t k = 0U; k < nval; k++) {
+			const size_t bo = coff[rhs[j + k] + 0U];
+			const size_t eo = coff[rhs[j + k] + 1U];
+
+			pval(o, line + bo, eo - bo - 1);
+			obuf_chr(o, '\t' + (k + 1U >= nval));
+		}
+	}
+	return nf;
+}
+
+static void
+mfls(struct mlt_s *restrict m, obuf_t o)
+{
+/* write out the binary rows of M */
+	if (m->bc != NULL) {
+		bcol_flush(m->bc, o);
+	}
+	return;
+}
+
+static void
+frmlt(struct mlt_s *restrict m)
+{
+	free(m->dln);
+	free(m->vb);
+	if (m->bc != NULL) {
+		bcol_close(m->bc);
+	}
+	return;
+}
+
+/* multi-threaded mode */
+#define CHNKZ	(1U << 20U)
+
+static int
+wrk1(void *wst, obuf_t o, const char *buf, size_t bz, size_t nr)
+{
+/* melt chunk BUF of size BZ, which consists of whole lines and whose
+ * first line is line NR + 1U */
+	struct mlt_s *m = wst;
+	const char *const eb = buf + bz;
+	int rc = 0;
+
+	for (const char *ln = buf, *eol; ln < eb; ln = eol) {
+		size_t nf;
+
+		/* chunks consist of whole lines */
+		eol = (const char*)memchr(ln, '\n', eb - ln) + 1U;
+		nr++;
+		if (UNLIKELY((nf = mlt1(m, o, ln, eol - ln)) < m->ncol)) {
+			errno = 0, error("\
+Error: line %zu has only %zu columns, expected %zu", nr, nf, m->ncol);
+			rc = 2;
+			break;
+		}
+	}
+	mfls(m, o);
+	return rc;
+}
+
+static int
+pll(rdln_t rd, const char *line, ssize_t nrd, size_t ncol, size_t nr)
+{
+/* cut input, from LINE onwards, into chunks of whole lines and have
+ * them melted by NTHR workers, output is in input order */
+	struct mlt_s w[nthr];
+	void *wst[nthr];
+	ppln_t p = NULL;
+	char *buf = NULL;
+	size_t bi = 0U;
+	size_t bz = 0U;
+	/* lines of mapped input are handed out in place, those of the
+	 * current chunk span [SB, SE) */
+	const int stblp = rdln_stablep(rd);
+	const char *sb = NULL, *se = NULL;
+	/* lines before the current chunk */
+	size_t nr0 = nr;
+	int rc = 0;
+
+	memset(w, 0, sizeof(w));
+	for (size_t i = 0U; i < nthr; i++) {
+		w[i].ncol = ncol;
+		w[i].coff = calloc(ncol + 1U, sizeof(*w[i].coff));
+		if (UNLIKELY(w[i].coff == NULL)) {
+			error("\
+Error: cannot allocate memory for worker %zu", i);
+			rc = -1;
+			goto out;
+		}
+		wst[i] = w + i;
+	}
+	if (UNLIKELY((p = ppln_open(nthr, wrk1, wst, ob)) == NULL)) {
+		error("\
+Error: cannot set up worker threads");
+		rc = -1;
+		goto out;
+	}
+
+	for (; nrd > 0; nrd = rdln_getln(&line, rd)) {
+		if (!stblp || UNLIKELY(line[nrd - 1U] != '\n')) {
+			/* copy him */
+			;
+		} else if (sb == NULL || line == se) {
+			/* lines are independent, cut anywhere */
+			sb = sb ?: line;
+			se = line + nrd;
+			nr++;
+			if (se - sb >= CHNKZ) {
+				rc = ppln_lend(p, sb, se - sb, nr0);
+				sb = NULL;
+				nr0 = nr;
+				if (UNLIKELY(rc)) {
+					break;
+				}
+			}
+			continue;
+		}
+		if (sb != NULL) {
+			/* not adjacent, or the last line, without newline */
+			rc = ppln_lend(p, sb, se - sb, nr0);
+			sb = NULL;
+			nr0 = nr;
+			if (UNLIKELY(rc)) {
+				break;
+			} else if (line[nrd - 1U] == '\n') {
+				/* start over with him */
+				sb = line;
+				se = line + nrd;
+				nr++;
+				continue;
+			}
+		}
+		if (UNLIKELY(bi + nrd >= bz)) {
+			char *nub;
+
+			while ((bz = (bz * 2U) ?: 2U * CHNKZ) <= bi + nrd);
+			if (UNLIKELY((nub = realloc(buf, bz)) == NULL)) {
+				error("\
+Error: cannot allocate memory for line %zu", nr + 1U);
+				rc = -1;
+				break;
+			}
+			buf = nub;
+		}
+		memcpy(buf + bi, line, nrd);
+		bi += nrd;
+		if (UNLIKELY(line[nrd - 1U] != '\n')) {
+			buf[bi++] = '\n';
+		}
+		nr++;
+
+		if (bi >= CHNKZ) {
+			/* lines are independent, cut anywhere */
+			rc = ppln_push(p, buf, bi, nr0);
+			buf = NULL;
+			bi = bz = 0U;
+			nr0 = nr;
+			if (UNLIKELY(rc)) {
+				break;
+			}
+		}
+	}
+	if (sb != NULL && !rc) {
+		rc = ppln_lend(p, sb, se - sb, nr0);
+	}
+	if (bi && !rc) {
+		rc = ppln_push(p, buf, bi, nr0);
+		buf = NULL;
+	}
+	with (int prc = ppln_close(p)) {
+		rc = prc ?: rc;
+	}
+
+out:
+	free(buf);
+	for (size_t i = 0U; i < nthr; i++) {
+		frmlt(w + i);
+		free(w[i].coff);
+	}
+	return rc;
+}
+
+static int
+stwh(const char *s)
+{
+/* set up the value predicate S, ~REGEX or LO..HI */
+	const char *r;
+	typv_t x;
+
+	if (*s == '~') {
+		whr = WHR_RX;
+		return -!!regcomp(&vrx, s + 1U, REG_EXTENDED | REG_NOSUB);
+	} else if ((r = strstr(s, "..")) == NULL) {
+		return -1;
+	}
+	whr = WHR_RNG;
+	/* dates if either end is one, numbers otherwise */
+	rtyp = typ_date(&x.t, s, r - s) >= 0 ||
+		typ_date(&x.t, r + 2U, strlen(r + 2U)) >= 0
+		? TYP_DATE : TYP_DBL;
+	if (r > s) {
+		if (typ_parse(&x, rtyp, s, r - s) < 0) {
+			return -1;
+		}
+		vlo = rtyp == TYP_DATE ? x.t : x.d;
+	}
+	if (*(r += 2U)) {
+		if (typ_parse(&x, rtyp, r, strlen(r)) < 0) {
+			return -1;
+		}
+		vhi = rtyp == TYP_DATE ? x.t : x.d;
+	}
+	return 0;
+}
+
+
+static int
+proc1(rdln_t rd)
 {
 	int rc = 0;
-	char *line = NULL;
-	size_t llen = 0U;
+	const char *line;
 	ssize_t nrd;
 	size_t ncol;
 	size_t *coff = NULL;
@@ -356,14 +1029,12 @@ proc1(void)
 	/* offsets for header and header buffer */
 	char *hn = NULL;
 	size_t *hoff = NULL;
-	size_t nxph;
-	/* constant dimension line */
-	size_t ndln = 0U;
-	size_t zdln = 0U;
-	char *dln = NULL;
+	size_t nxph = 0U;
+	/* melt state of the main thread */
+	struct mlt_s m0 = {0U};
 
 	/* probe */
-	if (UNLIKELY((nrd = getline(&line, &llen, stdin)) < 0)) {
+	if (UNLIKELY((nrd = rdln_getln(&line, rd)) < 0)) {
 		error("\
 Error: cannot read lines");
 		rc = -1;
@@ -391,9 +1062,13 @@ Error: cannot allocate memory to hold a copy of the header");
 		rc = -1;
 		goto out;
 	}
+	m0.ncol = ncol;
+	m0.coff = coff;
 
 	if (!hdrp) {
-		if (UNLIKELY((hn = mkhdrs(hoff, ncol)) == NULL)) {
+		stty(rd, line, nrd, ncol, coff);
+		if (UNLIKELY((hn = mkhdrs(hoff, ncol)) == NULL ||
+			     mkhd(hn, hoff, ncol, 0U) < 0)) {
 		error("\
 Error: cannot allocate memory to hold a copy of the header");
 		rc = -1;
@@ -435,68 +1110,47 @@ Error: product headers must have same number of factors");
 		rc = -1;
 		goto out;
 	}
-	if (cnmp && (nrd = getline(&line, &llen, stdin)) > 0) {
+	stty(rd, NULL, 0U, ncol, coff);
+	if (UNLIKELY(mkhd(hn, hoff, ncol, nxph) < 0)) {
+		error("\
+Error: cannot allocate memory to hold a copy of the header");
+		rc = -1;
+		goto out;
+	}
+	if (cnmp && (nrd = rdln_getln(&line, rd)) > 0) {
 		/* print col names */
 		phdr(hn, hoff, nxph);
 		goto tok;
 	}
 
-	while ((nrd = getline(&line, &llen, stdin)) > 0) {
-		size_t v, i;
+	while ((nrd = rdln_getln(&line, rd)) > 0) {
+		size_t nf;
 	tok:
+		if (nthr > 1U) {
+			/* leave the rest to the workers */
+			rc = pll(rd, line, nrd, ncol, nr);
+			break;
+		}
 		nr++;
-		size_t nf = tokln1(coff, ncol, line, nrd);
-
-		if (UNLIKELY(nf < ncol)) {
+		if (UNLIKELY((nf = mlt1(&m0, ob, line, nrd)) < ncol)) {
 			errno = 0, error("\
 Error: line %zu has only %zu columns, expected %zu", nr, nf, ncol);
 			rc = 2;
 			break;
 		}
-
-		/* construct constant dimension prefix */
-		for (i = 0U, ndln = 0U; i < nlhs; i++) {
-			const size_t bo = coff[lhs[i] + 0U];
-			const size_t eo = coff[lhs[i] + 1U];
-
-			if (UNLIKELY(ndln + eo - bo > zdln)) {
-				/* resize */
-				while ((zdln = (zdln * 2U) ?: 256U) <=
-				       ndln + eo - bo);
-				dln = realloc(dln, zdln * sizeof(*dln));
-			}
-			memcpy(dln + ndln, line + bo, eo - bo - 1);
-			ndln += eo - bo - 1;
-			dln[ndln++] = '\t';
-		}
-
-		if (UNLIKELY(!nrhs)) {
-			/* last tab to newline */
-			dln[ndln - 1U]++;
-			fwrite(dln, sizeof(*dln), ndln, stdout);
-			continue;
-		}
-		for (i = 0U; i < nrhs; i++) {
-			const size_t bo = coff[rhs[i] + 0U];
-			const size_t eo = coff[rhs[i] + 1U];
-			v = rhs[i];
-
-			fwrite(dln, sizeof(*dln), ndln, stdout);
-			/* header or index */
-			with (size_t hb = hoff[v + 0U], he = hoff[v + 1U]) {
-				fwrite(hn + hb, 1, he - hb - 1, stdout);
-			}
-			fputc('\t', stdout);
-			fwrite(line + bo, sizeof(*line), eo - bo - 1, stdout);
-			fputc('\n', stdout);
-		}
+	}
+	mfls(&m0, ob);
+	if (btyp != NULL) {
+		/* binary stream has begun */
+		bcol_end(ob);
 	}
 out:
+	frmlt(&m0);
 	free(coff);
-	free(dln);
 	free(hoff);
 	free(hn);
-	free(line);
+	free(hdt);
+	free(hdo);
 	return rc;
 }
 
@@ -507,17 +1161,56 @@ int
 main(int argc, char *argv[])
 {
 	static yuck_t argi[1U];
+	rdln_t rd;
 	int rc = 0;
 
 	if (yuck_parse(argi, argc, argv) < 0) {
 		rc = 1;
 		goto out;
 	}
+	if (UNLIKELY((ob = obuf_open(STDOUT_FILENO)) == NULL)) {
+		error("\
+Error: cannot set up output buffer");
+		rc = 1;
+		goto out;
+	}
 
 	/* overread and/or expect headers? */
 	hdrp = argi->header_flag;
 	/* memorise that we want col names for STCC() later on */
 	cnmp = argi->col_names_flag;
+	if (argi->types_arg) {
+		const char *t = argi->types_arg;
+
+		if (!strcmp(t, "auto")) {
+			/* infer */
+			vtyp = TYP_NIL;
+		} else if (UNLIKELY(!(vtyp = typ_of_name(t, strlen(t))))) {
+			errno = 0, error("\
+Error: unknown type `%s'", t);
+			rc = 1;
+			goto out;
+		}
+	}
+	if ((binp = argi->binary_flag)) {
+		/* names are part of the stream */
+		cnmp = 1;
+	}
+	narm = argi->na_rm_flag;
+	if (argi->where_value_arg &&
+	    UNLIKELY(stwh(argi->where_value_arg) < 0)) {
+		errno = 0, error("\
+Error: cannot interpret value predicate `%s'", argi->where_value_arg);
+		rc = 1;
+		goto out;
+	}
+	fltp = narm || whr;
+	if (argi->jobs_arg) {
+		nthr = strtoul(argi->jobs_arg, NULL, 10) ?: 1U;
+#if !defined HAVE_PTHREAD
+		nthr = 1U;
+#endif	/* !HAVE_PTHREAD */
+	}
 
 	/* snarf formula */
 	if (UNLIKELY(!argi->nargs ||
@@ -528,7 +1221,17 @@ Error: cannot interpret formula");
 		goto out;
 	}
 
-	rc = proc1() < 0;
+	if (UNLIKELY((rd = rdln_open(STDIN_FILENO)) == NULL)) {
+		error("\
+Error: cannot set up reader for stdin");
+		rc = 1;
+		goto out;
+	}
+
+	rc = proc1(rd) < 0;
+
+	rdln_close(rd);
+	free(btyp);
 
 	if (lhs != ELLIPSIS) {
 		free(lhs);
@@ -536,7 +1239,13 @@ Error: cannot interpret formula");
 	if (rhs != ELLIPSIS) {
 		free(rhs);
 	}
+	if (whr == WHR_RX) {
+		regfree(&vrx);
+	}
 out:
+	if (UNLIKELY(obuf_close(ob) < 0)) {
+		rc = 1;
+	}
 	yuck_free(argi);
 	return rc;
 }
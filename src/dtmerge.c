@@ -43,7 +43,16 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include "coru.h"
+#include "tok.h"
+#include "rdln.h"
+#include "obuf.h"
+#include "arena.h"
+#include "htab.h"
+#include "hash.h"
+#include "key.h"
 #include "nifty.h"
 
 struct hs_s {
@@ -57,13 +66,33 @@ struct hs_s {
 
 static int hdrp = 0;
 static int cnmp = 0;
+/* buffered stdout */
+static obuf_t ob;
 static int allx;
 static int ally;
 static const char *form;
+/* file names */
+static char **fn;
+/* what to do about files not sorted by key */
+static enum {
+	UNS_ERROR,
+	UNS_WARN,
+	UNS_HASH,
+	/* hash joins need no checking */
+	UNS_NONE,
+} unsa;
+/* set once a file was found unsorted, all readers stop then */
+static int unsp;
+/* whether readers run on threads of their own */
+static int thrp;
 
-/* join columns in left and right file */
-static struct hs_s jc[2U] = {{0, -1}, {0, -1}};
-static struct hs_s vc[2U] = {{0, -1}, {0, -1}};
+/* join columns and value columns of each of the NFILE files */
+static struct hs_s *jc;
+static struct hs_s *vc;
+static size_t nfile;
+/* comparators of the join columns */
+static keycmp_t *kc;
+/* the left and right file of a two-way join */
 #define L	0U
 #define R	1U
 
@@ -150,8 +179,12 @@ chck(struct hs_s *tg, const struct hs_s *sr, size_t ncol)
 }
 
 static int
-hdrs(const struct hs_s *x, const char *ln, const size_t *restrict of, char hc)
+hdrs(const struct hs_s *x, const char *ln, const size_t *restrict of,
+     const char *sfx)
 {
+/* append names of columns X to the header, suffixed .SFX unless NULL */
+	const size_t nsfx = sfx != NULL ? strlen(sfx) + 1U : 0U;
+
 	if (of) {
 		size_t c;
 		size_t i = 0U;
@@ -167,16 +200,17 @@ hdrs(const struct hs_s *x, const char *ln, const size_t *restrict of, char hc)
 		ons:
 			s = ln + of[c];
 			n = of[c + 1U] - of[c + 0U] - 1U;
-			if (UNLIKELY(nhdr + n + 2U >= zhdr)) {
-				while ((zhdr *= 2U) < nhdr + n);
+			if (UNLIKELY(nhdr + n + nsfx + 2U >= zhdr)) {
+				while ((zhdr *= 2U) < nhdr + n + nsfx + 2U);
 				hdr = realloc(hdr, zhdr * sizeof(*hdr));
 			}
 			memcpy(hdr + nhdr, s, n);
 			nhdr += n;
-			hdr[nhdr] = '.';
-			nhdr += !!hc;
-			hdr[nhdr] = hc;
-			nhdr += !!hc;
+			if (nsfx) {
+				hdr[nhdr++] = '.';
+				memcpy(hdr + nhdr, sfx, nsfx - 1U);
+				nhdr += nsfx - 1U;
+			}
 			hdr[nhdr++] = '\t';
 		}
 	} else {
@@ -192,17 +226,18 @@ hdrs(const struct hs_s *x, const char *ln, const size_t *restrict of, char hc)
 			c = x->p[i];
 		onc:
 			m = snprintf(hdr + nhdr, zhdr - nhdr, "V%zu", c + 1U);
-			if (UNLIKELY(nhdr + m + 2U >= zhdr)) {
-				zhdr *= 2U;
+			if (UNLIKELY(nhdr + m + nsfx + 2U >= zhdr)) {
+				while ((zhdr *= 2U) < nhdr + m + nsfx + 2U);
 				hdr = realloc(hdr, zhdr * sizeof(*hdr));
 				/* reprint */
 				snprintf(hdr + nhdr, zhdr - nhdr, "V%zu", ++c);
 			}
 			nhdr += m;
-			hdr[nhdr] = '.';
-			nhdr += !!hc;
-			hdr[nhdr] = hc;
-			nhdr += !!hc;
+			if (nsfx) {
+				hdr[nhdr++] = '.';
+				memcpy(hdr + nhdr, sfx, nsfx - 1U);
+				nhdr += nsfx - 1U;
+			}
 			hdr[nhdr++] = '\t';
 		}
 	}
@@ -210,37 +245,6 @@ hdrs(const struct hs_s *x, const char *ln, const size_t *restrict of, char hc)
 }
 
 
-static size_t
-toklng(const char *ln, size_t lz)
-{
-	const char *const ep = ln + lz;
-	size_t ncol = 1U;
-
-	for (const char *lp = ln, *np;
-	     (np = memchr(lp, '\t', ep - lp)); lp = np + 1U) {
-		ncol++;
-	}
-	return ncol;
-}
-
-static size_t
-tokln1(size_t *restrict c, size_t nc, const char *ln, size_t lz)
-{
-	const char *const ep = ln + lz;
-	size_t j = 0U;
-
-	lz -= ln[lz - 1] == '\n';
-
-	c[j++] = 0U;
-	for (const char *lp = ln, *np;
-	     j < nc && lp < ep && (np = memchr(lp, '\t', ep - lp));
-	     lp = np + 1U, j++) {
-		c[j] = np + 1U - ln;
-	}
-	c[j] = lz + 1U;
-	return j;
-}
-
 static ssize_t
 find_s(const char *ss, const size_t *of, size_t nc, const char *s, size_t z)
 {
@@ -266,7 +270,7 @@ snrf(struct hs_s *restrict tg, const char *hn, const size_t *of, size_t nc, size
 /* snarf FORM (global) into temporary TG based on header line HN and header OF
    over NC columns, I-th file, i.e. skip I = tokens in formula */
 	const char *ej, *j;
-	const char *on;
+	const char *on, *oe;
 	size_t nj;
 
 	j = form;
@@ -290,10 +294,13 @@ snrf(struct hs_s *restrict tg, const char *hn, const size_t *of, size_t nc, size
 
 	one_j:
 		on = memchrnul(j, '+', ej - j);
+		/* comparator suffixes are kc's business */
+		oe = on;
+		(void)key_sfx(j, &oe);
 		k = 0U;
 		do {
-			om = memchrnul(j, '=', on - j);
-		} while (om < on && k++ < i && (j = om + 1U, true));
+			om = memchrnul(j, '=', oe - j);
+		} while (om < oe && k++ < i && (j = om + 1U, true));
 
 		/* try with numbers first */
 		if ((x = strtoul(j, &tmp, 10)) && eatws(tmp) == om) {
@@ -324,39 +331,63 @@ prnc(const char *base, const size_t *cols, size_t i)
 {
 	const size_t bo = cols[i + 0U];
 	const size_t eo = cols[i + 1U];
-	fwrite(base + bo, sizeof(*base), eo - bo - 1U, stdout);
+	obuf_add(ob, base + bo, eo - bo - 1U);
 	return;
 }
 
 
 struct beef_s {
 	ssize_t nrd;
-	char *line;
+	const char *line;
 	/* intra-line */
 	size_t ncol;
 	size_t *coff;
 	/* line number */
 	size_t nr;
-	/* constant dimension line */
-	size_t ndln;
-	char *dln;
+	/* file the line is from */
+	size_t fibre;
+	/* join columns, encoded */
+	struct key_s key;
 };
 
+static void
+prnk(const struct beef_s *b)
+{
+/* print the join columns of line B */
+	const struct hs_s *j = jc + b->fibre;
+
+	if (!j->n) {
+		prnc(b->line, b->coff, j->v);
+		return;
+	}
+	prnc(b->line, b->coff, j->p[0U]);
+	for (size_t i = 1U; i < j->n; i++) {
+		obuf_chr(ob, '\t');
+		prnc(b->line, b->coff, j->p[i]);
+	}
+	return;
+}
+
 DEFCORU(co_proc1, {
-		FILE *fp;
+		rdln_t rd;
 		size_t fibre;
 	}, void *arg)
 {
-	FILE *const fp = CORU_CLOSUR(fp);
+	rdln_t rd = CORU_CLOSUR(rd);
 	size_t fibre = CORU_CLOSUR(fibre);
-	size_t llen = 0U;
-	struct beef_s b = {0U};
-	/* constant dimension line */
-	size_t zdln = 0U;
+	struct beef_s b = {.fibre = fibre};
+	/* key buffers, used alternately to keep the previous key */
+	unsigned char *key[2U] = {NULL, NULL};
+	size_t zkey[2U] = {0U, 0U};
+	struct key_s pk = {0U};
+	/* lines out of order */
+	size_t nuns = 0U;
+	/* whether lines outlive the next read */
+	const int stblp = rdln_stablep(rd);
 	int rc = 0;
 
 	/* probe */
-	if (UNLIKELY((b.nrd = getline(&b.line, &llen, fp)) < 0)) {
+	if (UNLIKELY((b.nrd = rdln_getln(&b.line, rd)) < 0)) {
 		error("\
 Error: cannot read lines");
 		rc = -1;
@@ -394,15 +425,21 @@ Error: fewer columns present than needed for formula");
 		/* record header line */
 		const char *ln = hdrp ? b.line : NULL;
 		size_t *of = hdrp ? b.coff : NULL;
-		char hc = 'x' + fibre;
+		/* suffixes x, y, z, then x4, x5, ... */
+		char sfx[24U];
 
-		if (!fibre && UNLIKELY(hdrs(jc, ln, of, 0) < 0)) {
+		if (fibre < 3U) {
+			sfx[0U] = (char)('x' + fibre), sfx[1U] = '\0';
+		} else {
+			snprintf(sfx, sizeof(sfx), "x%zu", fibre + 1U);
+		}
+		if (!fibre && UNLIKELY(hdrs(jc, ln, of, NULL) < 0)) {
 			error("\
 Error: cannot allocate memory to hold a copy of the header");
 			rc = -1;
 			goto out;
 		}
-		if (UNLIKELY(hdrs(&vc[fibre], ln, of, hc) < 0)) {
+		if (UNLIKELY(hdrs(&vc[fibre], ln, of, sfx) < 0)) {
 			error("\
 Error: cannot allocate memory to hold a copy of the header");
 			rc = -1;
@@ -414,11 +451,12 @@ Error: cannot allocate memory to hold a copy of the header");
 		goto tok;
 	}
 
-	while ((b.nrd = getline(&b.line, &llen, fp)) > 0) {
+	while ((b.nrd = rdln_getln(&b.line, rd)) > 0) {
 		size_t bo, eo, i;
 	tok:
 		b.nr++;
 		size_t nf = tokln1(b.coff, b.ncol, b.line, b.nrd);
+		const size_t w = b.nr & 1U;
 
 		if (UNLIKELY(nf < b.ncol)) {
 			errno = 0, error("\
@@ -427,8 +465,8 @@ Error: line %zu has only %zu columns, expected %zu", b.nr, nf, b.ncol);
 			break;
 		}
 
-		/* construct constant dimension prefix */
-		b.ndln = 0U;
+		/* encode the join columns */
+		b.key.z = 0U;
 		i = 0U;
 		if (!jc[fibre].n) {
 			bo = b.coff[jc[fibre].v + 0U];
@@ -438,103 +476,288 @@ Error: line %zu has only %zu columns, expected %zu", b.nr, nf, b.ncol);
 			bo = b.coff[jc[fibre].p[i] + 0U];
 			eo = b.coff[jc[fibre].p[i] + 1U];
 		one_l:
-			if (UNLIKELY(b.ndln + eo - bo > zdln)) {
+			if (UNLIKELY(b.key.z + KEY_ENCZ(eo - bo) > zkey[w])) {
 				/* resize */
-				while ((zdln = (zdln * 2U) ?: 256U) <=
-				       b.ndln + eo - bo);
-				b.dln = realloc(b.dln, zdln * sizeof(*b.dln));
+				while ((zkey[w] = (zkey[w] * 2U) ?: 256U) <
+				       b.key.z + KEY_ENCZ(eo - bo));
+				key[w] = realloc(key[w], zkey[w]);
+				if (UNLIKELY(key[w] == NULL)) {
+					error("\
+Error: cannot allocate memory to hold the key of line %zu", b.nr);
+					rc = -1;
+					goto out;
+				}
 			}
-			memcpy(b.dln + b.ndln, b.line + bo, eo - bo - 1);
-			b.ndln += eo - bo - 1;
-			b.dln[b.ndln++] = '\t';
+			b.key.z += key_enc(key[w] + b.key.z, kc[i],
+					   b.line + bo, eo - bo - 1U);
 		}
-		/* terminate dln */
-		b.dln[--b.ndln] = '\0';
+		b.key.k = key[w];
+		b.key.pfx = key_pfx(key[w], b.key.z);
+
+		/* keys mustn't decrease */
+		if (LIKELY(unsa == UNS_NONE || b.nr <= 1U ||
+			   key_cmp(&pk, &b.key) <= 0)) {
+			;
+		} else if (unsa == UNS_WARN) {
+			if (!nuns++) {
+				errno = 0, error("\
+Warning: line %zu of `%s' is out of order", b.nr + hdrp, fn[fibre]);
+			}
+		} else {
+			if (unsa == UNS_ERROR) {
+				errno = 0, error("\
+Error: line %zu of `%s' is out of order", b.nr + hdrp, fn[fibre]);
+			}
+			__atomic_store_n(&unsp, 1, __ATOMIC_RELAXED);
+			rc = -1;
+			break;
+		}
+		pk = b.key;
 
 		/* prep yield */
 		*(struct beef_s*)arg = b;
-		if (YIELD(1) < 0) {
+		if (THREADP(ctx->next)) {
+			/* the coordinator sees this line only after we've
+			 * moved on, so offsets, key and, if need be, the line
+			 * itself must go along */
+			struct beef_s *y = arg;
+			const size_t zo = (b.ncol + 1U) * sizeof(*b.coff);
+			const size_t zl = stblp ? 0U : (size_t)b.nrd;
+			char *p = YALLOC(zo + b.key.z + zl);
+
+			if (UNLIKELY(p == NULL)) {
+				error("\
+Error: cannot allocate memory to hand over line %zu", b.nr);
+				rc = -1;
+				break;
+			}
+			y->coff = memcpy(p, b.coff, zo);
+			y->key.k = memcpy(p + zo, b.key.k, b.key.z);
+			if (zl) {
+				y->line = memcpy(p + zo + b.key.z, b.line, zl);
+			}
+		}
+		if (YIELD(1) < 0 ||
+		    UNLIKELY(__atomic_load_n(&unsp, __ATOMIC_RELAXED))) {
 			break;
 		}
 	}
-out:
-	if (jc[fibre].n) {
-		free(jc[fibre].p);
-	}
-	if (vc[fibre].n) {
-		free(vc[fibre].p);
+	if (UNLIKELY(nuns > 1U)) {
+		errno = 0, error("\
+Warning: %zu lines of `%s' are out of order", nuns, fn[fibre]);
 	}
+out:
 	free(b.coff);
-	free(b.dln);
-	free(b.line);
+	free(key[0U]);
+	free(key[1U]);
 	return rc;
 }
 
+static struct cocore*
+strt(struct cocore *self, rdln_t rd, size_t fibre)
+{
+/* start reading RD as FIBRE, on a thread of its own if asked to */
+	struct cocore *c;
+
+	if (thrp &&
+	    (c = START_THREAD_PACK(co_proc1, sizeof(struct beef_s),
+				   .clo = {.rd = rd, .fibre = fibre}))) {
+		return c;
+	}
+	return START_PACK(co_proc1, .next = self,
+			  .clo = {.rd = rd, .fibre = fibre});
+}
+
 static void
 prnt(const struct beef_s *x, const struct beef_s *y)
 {
 	static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
 
 	if (x && y) {
-		fwrite(y->dln, 1, y->ndln, stdout);
+		prnk(y);
 	} else if (x && allx) {
-		fwrite(x->dln, 1, x->ndln, stdout);
+		prnk(x);
 	} else if (y && ally) {
-		fwrite(y->dln, 1, y->ndln, stdout);
+		prnk(y);
 	} else {
 		return;
 	}
 	if (x) {
 		for (size_t i = 0U; i < vc[L].n; i++) {
-			fputc('\t', stdout);
+			obuf_chr(ob, '\t');
 			prnc(x->line, x->coff, vc[L].p[i]);
 		}
 	} else if (ally) {
 		for (size_t i = 0U; i < vc[L].n / 16U; i++) {
-			fwrite(tabs, sizeof(*tabs), countof(tabs), stdout);
+			obuf_add(ob, tabs, countof(tabs));
 		}
-		fwrite(tabs, sizeof(*tabs), vc[L].n % 16U, stdout);
+		obuf_add(ob, tabs, vc[L].n % 16U);
 	}
 	if (y) {
 		for (size_t i = 0U; i < vc[R].n; i++) {
-			fputc('\t', stdout);
+			obuf_chr(ob, '\t');
 			prnc(y->line, y->coff, vc[R].p[i]);
 		}
 	} else if (allx) {
 		for (size_t i = 0U; i < vc[R].n / 16U; i++) {
-			fwrite(tabs, sizeof(*tabs), countof(tabs), stdout);
+			obuf_add(ob, tabs, countof(tabs));
 		}
-		fwrite(tabs, sizeof(*tabs), vc[R].n % 16U, stdout);
+		obuf_add(ob, tabs, vc[R].n % 16U);
 	}
-	fputc('\n', stdout);
+	obuf_chr(ob, '\n');
 	return;
 }
 
+
+/* lines kept around, copied back to back into LN, OF holds for each
+ * line a struct lnh_s followed by its NCOL + 1U field offsets */
+struct lns_s {
+	struct arena_s ln;
+	struct arena_s of;
+	/* encoded keys */
+	struct arena_s key;
+	size_t ncol;
+	size_t fibre;
+	size_t n;
+};
+
+struct lnh_s {
+	size_t lo;
+	size_t lz;
+	size_t ko;
+	size_t kz;
+	uint64_t kp;
+};
+
+static inline size_t
+lnhz(size_t ncol)
+{
+/* size of a line's entry in the OF arena */
+	return sizeof(struct lnh_s) + (ncol + 1U) * sizeof(size_t);
+}
+
 static int
-proc(FILE *fpx, FILE *fpy)
+lpush(struct lns_s *restrict l, const struct beef_s *b)
 {
-/* coordinator between fpx and fpy */
+/* keep a copy of line B in L as line L->N */
+	const size_t lo = arena_add(&l->ln, b->line, b->nrd);
+	const size_t ko = arena_add(&l->key, b->key.k, b->key.z);
+	const size_t oo = arena_alloc(&l->of, lnhz(b->ncol));
+	struct lnh_s *h;
+
+	if (UNLIKELY(lo == ARENA_NIL || ko == ARENA_NIL || oo == ARENA_NIL)) {
+		return -1;
+	}
+	h = arena_ptr(&l->of, oo);
+	*h = (struct lnh_s){lo, b->nrd, ko, b->key.z, b->key.pfx};
+	memcpy(h + 1U, b->coff, (b->ncol + 1U) * sizeof(*b->coff));
+	l->ncol = b->ncol;
+	l->fibre = b->fibre;
+	l->n++;
+	return 0;
+}
+
+static struct beef_s
+lline(const struct lns_s *l, size_t k)
+{
+/* line K of L */
+	struct lnh_s *h = arena_ptr(&l->of, k * lnhz(l->ncol));
+
+	return (struct beef_s){
+		.nrd = h->lz,
+		.line = arena_ptr(&l->ln, h->lo),
+		.ncol = l->ncol,
+		.coff = (void*)(h + 1U),
+		.fibre = l->fibre,
+		.key = {h->kp, h->kz, arena_ptr(&l->key, h->ko)},
+	};
+}
+
+static inline bool
+runp(const struct lns_s *r, const struct beef_s *b)
+{
+/* whether B continues run R, i.e. has the key of R's first line */
+	const struct lnh_s *h = arena_ptr(&r->of, 0U);
+	const struct key_s k = {h->kp, h->kz, arena_ptr(&r->key, h->ko)};
+
+	return key_eq(&b->key, &k);
+}
+
+static void
+lreset(struct lns_s *restrict l)
+{
+	arena_reset(&l->ln);
+	arena_reset(&l->of);
+	arena_reset(&l->key);
+	l->n = 0U;
+	return;
+}
+
+static void
+lfree(struct lns_s *restrict l)
+{
+	arena_fini(&l->ln);
+	arena_fini(&l->of);
+	arena_fini(&l->key);
+	return;
+}
+
+static void
+rprod(const struct lns_s *r, const struct beef_s *x, const struct beef_s *y)
+{
+/* print X (or Y if X is NULL) joined with every line of run R */
+	for (size_t k = 0U; k < r->n; k++) {
+		const struct beef_s z = lline(r, k);
+
+		prnt(x ?: &z, x ? &z : y);
+	}
+	return;
+}
+
+static void
+rcross(const struct lns_s *rx, const struct lns_s *ry, bool ymaj)
+{
+/* print the cross product of runs RX and RY, x-major unless YMAJ */
+	const struct lns_s *const r = ymaj ? ry : rx;
+
+	for (size_t k = 0U; k < r->n; k++) {
+		const struct beef_s z = lline(r, k);
+
+		if (ymaj) {
+			rprod(rx, NULL, &z);
+		} else {
+			rprod(ry, &z, NULL);
+		}
+	}
+	return;
+}
+
+static int
+proc(rdln_t rx, rdln_t ry)
+{
+/* coordinator between rx and ry */
 	int rc = 0;
 	struct cocore *self = PREP();
-	struct cocore *px = START_PACK(co_proc1, .next = self,
-				       .clo = {.fp = fpx, .fibre = 0U});
-	struct cocore *py = START_PACK(co_proc1, .next = self,
-				       .clo = {.fp = fpy, .fibre = 1U});
+	struct cocore *px = strt(self, rx, 0U);
+	struct cocore *py = strt(self, ry, 1U);
 	struct beef_s bx;
 	struct beef_s by;
+	/* runs of equal keys */
+	struct lns_s run[2U];
 	int sx = NEXT1(px, &bx);
 	int sy = NEXT1(py, &by);
 
+	memset(run, 0, sizeof(run));
 	if (cnmp && sx > 0 && sy > 0) {
 		hdr[nhdr - 1U] = '\n';
-		fwrite(hdr + 1U, sizeof(*hdr), nhdr - 1U, stdout);
+		obuf_add(ob, hdr + 1U, nhdr - 1U);
 	}
 
 	for (int c; sx > 0 || sy > 0;
 	     sx = NEXT1(px, &bx), sy = NEXT1(py, &by)) {
 		if (sx > 0 && sy > 0) {
 		redo:
-			c = strcmp(bx.dln, by.dln);
+			c = key_cmp(&bx.key, &by.key);
 
 			if (0) {
 				;
@@ -558,10 +781,57 @@ proc(FILE *fpx, FILE *fpy)
 					goto rest_x;
 				}
 				goto redo;
+			}
+			/* keys are equal, buffer both runs in turn until
+			 * one of them ends, only the shorter one (and as
+			 * many lines of the other) is ever held */
+			lreset(run + L);
+			lreset(run + R);
+			if (UNLIKELY(lpush(run + L, &bx) < 0) ||
+			    UNLIKELY(lpush(run + R, &by) < 0)) {
+				goto nomem;
+			}
+			while (1) {
+				sx = NEXT1(px, &bx);
+				if (sx <= 0 || !runp(run + L, &bx)) {
+					break;
+				} else if (UNLIKELY(lpush(run + L, &bx) < 0)) {
+					goto nomem;
+				}
+				sy = NEXT1(py, &by);
+				if (sy <= 0 || !runp(run + R, &by)) {
+					break;
+				} else if (UNLIKELY(lpush(run + R, &by) < 0)) {
+					goto nomem;
+				}
+			}
+			if (sx > 0 && runp(run + L, &bx)) {
+				/* y run complete, stream the rest of x */
+				rcross(run + L, run + R, false);
+				while ((sx = NEXT1(px, &bx)) > 0 &&
+				       runp(run + L, &bx)) {
+					rprod(run + R, &bx, NULL);
+				}
+			} else if ((sy = NEXT1(py, &by)) > 0 &&
+				   runp(run + R, &by)) {
+				/* x run complete, stream the rest of y */
+				rcross(run + L, run + R, true);
+				do {
+					rprod(run + L, NULL, &by);
+				} while ((sy = NEXT1(py, &by)) > 0 &&
+					 runp(run + R, &by));
 			} else {
-				/* keys are equal do a col-by-col comparison */
-				prnt(&bx, &by);
+				/* both complete */
+				rcross(run + L, run + R, false);
 			}
+			if (sx > 0 && sy > 0) {
+				goto redo;
+			} else if (sx > 0) {
+				goto rest_x;
+			} else if (sy > 0) {
+				goto rest_y;
+			}
+			break;
 		} else if (sx > 0) {
 		rest_x:
 			/* we're out of BYs */
@@ -578,10 +848,345 @@ proc(FILE *fpx, FILE *fpy)
 			break;
 		}
 	}
+	if (0) {
+	nomem:
+		error("\
+Error: cannot allocate memory to hold a run of equal keys");
+		rc = -1;
+	}
+	lfree(run + L);
+	lfree(run + R);
+	STOP(px);
+	STOP(py);
+	UNPREP();
+	return rc;
+}
+
+static int
+hproc(rdln_t rx, rdln_t ry, size_t b)
+{
+/* coordinator between rx and ry, lines of side B are hashed by key
+ * then those of the other side are looked up as they come */
+	int rc = 0;
+	struct cocore *self = PREP();
+	struct cocore *pc[2U] = {strt(self, rx, 0U), strt(self, ry, 1U)};
+	/* probe side */
+	const size_t p = b ^ R;
+	struct beef_s bb[2U];
+	int sb[2U];
+	/* build side lines and their index */
+	struct lns_s t;
+	struct htab_s h = {0U};
+	/* build side lines that found a match */
+	char *hit = NULL;
+
+	sb[L] = NEXT1(pc[L], bb + L);
+	sb[R] = NEXT1(pc[R], bb + R);
+
+	memset(&t, 0, sizeof(t));
+	if (cnmp && sb[L] > 0 && sb[R] > 0) {
+		hdr[nhdr - 1U] = '\n';
+		obuf_add(ob, hdr + 1U, nhdr - 1U);
+	}
+
+	for (; sb[b] > 0; sb[b] = NEXT1(pc[b], bb + b)) {
+		const uint64_t k = hash(bb[b].key.k, bb[b].key.z);
+
+		if (UNLIKELY(lpush(&t, bb + b) < 0) ||
+		    UNLIKELY(htab_put(&h, k, t.n - 1U) < 0)) {
+			goto nomem;
+		}
+	}
+	if ((b == L ? allx : ally) &&
+	    UNLIKELY((hit = calloc(t.n + 1U, sizeof(*hit))) == NULL)) {
+		goto nomem;
+	}
+
+	for (; sb[p] > 0; sb[p] = NEXT1(pc[p], bb + p)) {
+		const struct beef_s *z = bb + p;
+		const uint64_t k = hash(z->key.k, z->key.z);
+		size_t q = htab_home(&h, k);
+		bool m = false;
+
+		for (size_t i; (i = htab_next(&h, k, &q)) != HTAB_NIL;) {
+			const struct beef_s w = lline(&t, i);
+
+			if (!key_eq(&w.key, &z->key)) {
+				/* hash collision */
+				continue;
+			}
+			prnt(b == L ? &w : z, b == L ? z : &w);
+			if (hit != NULL) {
+				hit[i] = 1;
+			}
+			m = true;
+		}
+		if (!m) {
+			prnt(b == L ? NULL : z, b == L ? z : NULL);
+		}
+	}
+	/* build side lines without match, in order */
+	for (size_t i = 0U; hit != NULL && i < t.n; i++) {
+		if (!hit[i]) {
+			const struct beef_s w = lline(&t, i);
+			prnt(b == L ? &w : NULL, b == L ? NULL : &w);
+		}
+	}
+
+	if (0) {
+	nomem:
+		error("\
+Error: cannot allocate memory to hold the lines to hash");
+		rc = -1;
+	}
+	free(hit);
+	htab_fini(&h);
+	lfree(&t);
+	STOP(pc[L]);
+	STOP(pc[R]);
+	UNPREP();
+	return rc;
+}
+
+static void
+prntk(const struct beef_s *const *z, size_t n)
+{
+/* print the lines Z of N files joined, absent (NULL) ones as empty */
+	static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+	for (size_t i = 0U; i < n; i++) {
+		if (z[i] != NULL) {
+			prnk(z[i]);
+			break;
+		}
+	}
+	for (size_t i = 0U; i < n; i++) {
+		if (z[i] != NULL) {
+			for (size_t j = 0U; j < vc[i].n; j++) {
+				obuf_chr(ob, '\t');
+				prnc(z[i]->line, z[i]->coff, vc[i].p[j]);
+			}
+			continue;
+		}
+		for (size_t j = 0U; j < vc[i].n / 16U; j++) {
+			obuf_add(ob, tabs, countof(tabs));
+		}
+		obuf_add(ob, tabs, vc[i].n % 16U);
+	}
+	obuf_chr(ob, '\n');
+	return;
+}
+
+static void
+kjoin(const struct lns_s *run, size_t n)
+{
+/* print the cross product of the N runs, the first varying slowest,
+ * empty runs take part as empty columns if the join is outer enough */
+	struct beef_s w[n];
+	const struct beef_s *z[n];
+	size_t k[n];
+	size_t np = 0U;
+
+	for (size_t i = 0U; i < n; i++) {
+		np += run[i].n > 0U;
+		k[i] = 0U;
+	}
+	if (np < n && !(allx && ally) &&
+	    !(allx && run[0U].n) && !(ally && run[n - 1U].n)) {
+		return;
+	}
+	for (size_t i;;) {
+		for (i = 0U; i < n; i++) {
+			z[i] = NULL;
+			if (run[i].n) {
+				w[i] = lline(run + i, k[i]);
+				z[i] = w + i;
+			}
+		}
+		prntk(z, n);
+		/* advance, the last run fastest */
+		for (i = n; i-- > 0U && ++k[i] >= run[i].n; k[i] = 0U);
+		if (i >= n) {
+			break;
+		}
+	}
+	return;
+}
+
+static inline bool
+klt(const struct beef_s *b, size_t i, size_t j)
+{
+/* whether file I's key comes before file J's, ties broken by file */
+	const int c = key_cmp(&b[i].key, &b[j].key);
+	return c < 0 || !c && i < j;
+}
+
+static void
+hput(size_t *restrict hp, size_t *restrict nh, const struct beef_s *b, size_t i)
+{
+/* add file I to the heap HP of size NH */
+	size_t c = (*nh)++;
+
+	for (size_t p; c && klt(b, i, hp[p = (c - 1U) / 2U]); c = p) {
+		hp[c] = hp[p];
+	}
+	hp[c] = i;
+	return;
+}
+
+static size_t
+hpop(size_t *restrict hp, size_t *restrict nh, const struct beef_s *b)
+{
+/* remove and return the file with the least key from the heap HP */
+	const size_t r = hp[0U];
+	const size_t x = hp[--*nh];
+	size_t c = 0U;
+
+	for (size_t l; (l = 2U * c + 1U) < *nh; c = l) {
+		l += l + 1U < *nh && klt(b, hp[l + 1U], hp[l]);
+		if (!klt(b, hp[l], x)) {
+			break;
+		}
+		hp[c] = hp[l];
+	}
+	hp[c] = x;
+	return r;
+}
+
+static int
+kproc(const rdln_t *rd, size_t n)
+{
+/* coordinator between N readers RD, a min-heap over their current
+ * keys yields the next key, the runs of all files carrying it are
+ * buffered and joined */
+	int rc = 0;
+	struct cocore *self;
+	struct cocore *pc[n];
+	struct beef_s b[n];
+	int sb[n];
+	struct lns_s run[n];
+	/* files with lines left, by key */
+	size_t hp[n];
+	size_t nh = 0U;
+	/* the current key */
+	unsigned char *key = NULL;
+	size_t zkey = 0U;
+	struct key_s k;
+	bool allp = true;
+
+	/* only now, coroutine stacks begin below the current frame */
+	self = PREP();
+	memset(run, 0, sizeof(run));
+	for (size_t i = 0U; i < n; i++) {
+		pc[i] = strt(self, rd[i], i);
+	}
+	for (size_t i = 0U; i < n; i++) {
+		sb[i] = NEXT1(pc[i], b + i);
+		allp = allp && sb[i] > 0;
+	}
+	if (cnmp && allp) {
+		hdr[nhdr - 1U] = '\n';
+		obuf_add(ob, hdr + 1U, nhdr - 1U);
+	}
+	for (size_t i = 0U; i < n; i++) {
+		if (sb[i] > 0) {
+			hput(hp, &nh, b, i);
+		}
+	}
+
+	while (nh) {
+		const struct beef_s *m = b + hp[0U];
+
+		if (UNLIKELY(m->key.z > zkey)) {
+			while ((zkey = (zkey * 2U) ?: 256U) < m->key.z);
+			if (UNLIKELY((key = realloc(key, zkey)) == NULL)) {
+				goto nomem;
+			}
+		}
+		k = (struct key_s){m->key.pfx, m->key.z, key};
+		memcpy(key, m->key.k, m->key.z);
+		for (size_t i = 0U; i < n; i++) {
+			lreset(run + i);
+		}
+		while (nh && key_eq(&b[hp[0U]].key, &k)) {
+			const size_t i = hpop(hp, &nh, b);
+
+			do {
+				if (UNLIKELY(lpush(run + i, b + i) < 0)) {
+					goto nomem;
+				}
+			} while ((sb[i] = NEXT1(pc[i], b + i)) > 0 &&
+				 key_eq(&b[i].key, &k));
+			if (sb[i] > 0) {
+				hput(hp, &nh, b, i);
+			}
+		}
+		kjoin(run, n);
+	}
+
+	if (0) {
+	nomem:
+		error("\
+Error: cannot allocate memory to hold a run of equal keys");
+		rc = -1;
+	}
+	for (size_t i = 0U; i < n; i++) {
+		lfree(run + i);
+		STOP(pc[i]);
+	}
+	free(key);
 	UNPREP();
 	return rc;
 }
 
+static int
+vproc(rdln_t rx, rdln_t ry)
+{
+/* read RX and RY through, return non-0 if either isn't sorted by key */
+	struct cocore *self = PREP();
+	struct cocore *px = strt(self, rx, 0U);
+	struct cocore *py = strt(self, ry, 1U);
+	struct beef_s b;
+
+	while (NEXT1(px, &b) > 0);
+	while (NEXT1(py, &b) > 0);
+	STOP(px);
+	STOP(py);
+	UNPREP();
+	return unsp;
+}
+
+static void
+frcols(void)
+{
+/* forget the join and value columns of all files */
+	for (size_t i = 0U; i < nfile; i++) {
+		if (jc[i].n) {
+			free(jc[i].p);
+		}
+		if (vc[i].n) {
+			free(vc[i].p);
+		}
+		memset(jc + i, 0, sizeof(*jc));
+		memset(vc + i, 0, sizeof(*vc));
+	}
+	return;
+}
+
+static size_t
+hsid(int fdx, int fdy)
+{
+/* side to hash, the smaller file, or the right one if sizes are unknown */
+	struct stat stx, sty;
+
+	if (fstat(fdx, &stx) < 0 || !S_ISREG(stx.st_mode)) {
+		return R;
+	} else if (fstat(fdy, &sty) < 0 || !S_ISREG(sty.st_mode)) {
+		return L;
+	}
+	return stx.st_size < sty.st_size ? L : R;
+}
+
 
 #include "dtmerge.yucc"
 
@@ -589,38 +1194,89 @@ int
 main(int argc, char *argv[])
 {
 	static yuck_t argi[1U];
-	static FILE *fpx;
-	static FILE *fpy;
+	static int *fd;
+	static rdln_t *rd;
 	int rc = 0;
 
 	if (yuck_parse(argi, argc, argv) < 0) {
 		rc = 1;
 		goto out;
 	}
+	if (UNLIKELY((ob = obuf_open(STDOUT_FILENO)) == NULL)) {
+		error("\
+Error: cannot set up output buffer");
+		rc = 1;
+		goto out;
+	}
 
 	/* overread and/or expect headers? */
 	hdrp = argi->header_flag;
 	/* memorise that we want col names for STCC() later on */
 	cnmp = argi->col_names_flag;
+	/* readers on threads, if they can be had */
+	thrp = argi->threads_flag;
 
 	if (argi->nargs < 3U) {
 		errno = 0, error("\
 Error: need two files and a formula");
 		rc = 1;
 		goto out;
-	} else if (UNLIKELY(!(fpx = fopen(argi->args[0U], "r")))) {
+	}
+	/* all but the last argument are files */
+	nfile = argi->nargs - 1U;
+	fn = argi->args;
+	if (argi->hash_flag && nfile > 2U) {
+		errno = 0, error("\
+Error: --hash can only join two files");
+		rc = 1;
+		goto out;
+	}
+	if (!argi->unsorted_arg || !strcmp(argi->unsorted_arg, "error")) {
+		unsa = UNS_ERROR;
+	} else if (!strcmp(argi->unsorted_arg, "warn")) {
+		unsa = UNS_WARN;
+	} else if (!strcmp(argi->unsorted_arg, "hash") && nfile <= 2U) {
+		unsa = UNS_HASH;
+	} else {
+		errno = 0, error("\
+Error: --unsorted must be error, warn, or for two files hash");
+		rc = 1;
+		goto out;
+	}
+	if (argi->hash_flag) {
+		unsa = UNS_NONE;
+	}
+	fd = malloc(nfile * sizeof(*fd));
+	rd = calloc(nfile, sizeof(*rd));
+	jc = calloc(nfile, sizeof(*jc));
+	vc = calloc(nfile, sizeof(*vc));
+	if (UNLIKELY(fd == NULL || rd == NULL || jc == NULL || vc == NULL)) {
 		error("\
-Error: cannot open `%s' for reading", argi->args[0U]);
+Error: cannot allocate memory for %zu files", nfile);
+		nfile = 0U;
 		rc = 1;
 		goto clo;
-	} else if (UNLIKELY(!(fpy = fopen(argi->args[1U], "r")))) {
+	}
+	for (size_t i = 0U; i < nfile; i++) {
+		fd[i] = -1;
+	}
+	for (size_t i = 0U; i < nfile; i++) {
+		if (UNLIKELY((fd[i] = open(fn[i], O_RDONLY)) < 0 ||
+			     (rd[i] = rdln_open(fd[i])) == NULL)) {
+			error("\
+Error: cannot open `%s' for reading", fn[i]);
+			rc = 1;
+			goto clo;
+		}
+	}
+	/* keep track of the formula */
+	form = argi->args[nfile];
+	if (UNLIKELY((kc = key_form(form, strlen(form))) == NULL)) {
 		error("\
-Error: cannot open `%s' for reading", argi->args[1U]);
+Error: cannot allocate memory for the formula");
 		rc = 1;
 		goto clo;
 	}
-	/* keep track of the formula */
-	form = argi->args[2U];
 
 	if (argi->all_arg) {
 		allx = argi->all_arg == YUCK_OPTARG_NONE ||
@@ -644,18 +1300,52 @@ Error: cannot allocate space for header");
 	/* get the coroutines going */
 	initialise_cocore();
 
-	rc = proc(fpx, fpy) < 0;
+	if (unsa == UNS_HASH &&
+	    rdln_rewind(rd[L]) >= 0 && rdln_rewind(rd[R]) >= 0) {
+		/* check beforehand, then start over */
+		const bool sortp = !vproc(rd[L], rd[R]);
+
+		frcols();
+		nhdr = 1U;
+		unsp = 0;
+		(void)rdln_rewind(rd[L]);
+		(void)rdln_rewind(rd[R]);
+		unsa = sortp ? UNS_ERROR : UNS_NONE;
+	} else if (unsa == UNS_HASH) {
+		/* no second chance, hash right away */
+		unsa = UNS_NONE;
+	}
+
+	if (nfile > 2U) {
+		rc = kproc(rd, nfile) < 0;
+	} else if (unsa != UNS_NONE) {
+		rc = proc(rd[L], rd[R]) < 0;
+	} else {
+		rc = hproc(rd[L], rd[R], hsid(fd[L], fd[R])) < 0;
+	}
+	rc = rc || unsp;
 
 	free(hdr);
 
 clo:
-	if (fpx) {
-		fclose(fpx);
-	}
-	if (fpy) {
-		fclose(fpy);
+	/* lines kept by the coordinators may outlive their coroutines,
+	 * so columns are freed only now */
+	frcols();
+	for (size_t i = 0U; i < nfile; i++) {
+		rdln_close(rd[i]);
+		if (fd[i] >= 0) {
+			close(fd[i]);
+		}
 	}
+	free(fd);
+	free(rd);
+	free(jc);
+	free(vc);
+	free(kc);
 out:
+	if (UNLIKELY(obuf_close(ob) < 0)) {
+		rc = 1;
+	}
 	yuck_free(argi);
 	return rc;
 }
@@ -42,11 +42,14 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <fcntl.h>
+#include "tok.h"
+#include "rdln.h"
+#include "obuf.h"
 #include "nifty.h"
 
-/* global line buffer */
-static char *line;
-static size_t llen;
+/* buffered stdout */
+static obuf_t ob;
 /* union header */
 char *hdr;
 size_t nhdr;
@@ -79,37 +82,6 @@ error(const char *fmt, ...)
 }
 
 
-static size_t
-toklng(const char *ln, size_t lz)
-{
-	const char *const ep = ln + lz;
-	size_t ncol = 1U;
-
-	for (const char *lp = ln, *np;
-	     (np = memchr(lp, '\t', ep - lp)); lp = np + 1U) {
-		ncol++;
-	}
-	return ncol;
-}
-
-static size_t
-tokln1(size_t *restrict c, size_t nc, const char *ln, size_t lz)
-{
-	const char *const ep = ln + lz;
-	size_t j = 0U;
-
-	lz -= ln[lz - 1] == '\n';
-
-	c[j++] = 0U;
-	for (const char *lp = ln, *np;
-	     j < nc && lp < ep && (np = memchr(lp, '\t', ep - lp));
-	     lp = np + 1U, j++) {
-		c[j] = np + 1U - ln;
-	}
-	c[j] = lz + 1U;
-	return j;
-}
-
 static ssize_t
 addhdr(const char *s, size_t n)
 {
@@ -151,15 +123,16 @@ addhdr(const char *s, size_t n)
 
 
 static int
-proc_hdr(FILE *fp)
+proc_hdr(rdln_t rd)
 {
+	const char *line;
 	ssize_t nrd;
 	size_t ncol;
 
 	/* just in case we have to leave all of a sudden */
 	perm[nperm++] = 0U;
 
-	if (UNLIKELY((nrd = getline(&line, &llen, fp)) < 0)) {
+	if (UNLIKELY((nrd = rdln_getln(&line, rd)) < 0)) {
 		return -1;
 	}
 	ncol = toklng(line, nrd);
@@ -188,14 +161,20 @@ proc_hdr(FILE *fp)
 }
 
 static int
-proc_res(FILE *fp)
+proc_res(rdln_t rd)
 {
 	static size_t iperm;
 	size_t invp[nhof];
+	const char *line;
 	ssize_t nrd;
 	size_t ncol;
 	int rc = 0;
 
+	if (UNLIKELY(rd == NULL)) {
+		/* file couldn't be opened, no header recorded either */
+		return -1;
+	}
+
 	ncol = perm[iperm++];
 	/* construct inverse perm */
 	memset(invp, 0, sizeof(invp));
@@ -215,11 +194,15 @@ proc_res(FILE *fp)
 	with (size_t coff[ncol + 1U]) {
 		char res[nhof - ncol + 1U];
 		size_t nr = 1U;
+		/* lines of mapped files that go out as they are, the
+		 * current span of them is [SB, SE) */
+		const int stblp = rdln_stablep(rd) && ncol == nhof;
+		const char *sb = NULL, *se = NULL;
 
 		/* prepare rest of line */
 		memset(res, '\t', nhof - ncol);
 		res[nhof - ncol] = '\n';
-		while ((nrd = getline(&line, &llen, fp)) > 0) {
+		while ((nrd = rdln_getln(&line, rd)) > 0) {
 			nr++;
 			if (UNLIKELY(tokln1(coff, ncol, line, nrd) < ncol)) {
 				errno = 0, error("\
@@ -227,8 +210,22 @@ Error: line %zu has fewer than %zu columns", nr, ncol);
 				rc = 2;
 				break;
 			}
-			fwrite(line, 1, coff[ncol] - 1U, stdout);
-			fwrite(res, 1, nhof - ncol + 1U, stdout);
+			if (sb != NULL && line != se) {
+				obuf_ref(ob, sb, se - sb);
+				sb = NULL;
+			}
+			if (stblp && coff[ncol] == (size_t)nrd &&
+			    line[nrd - 1U] == '\n') {
+				/* verbatim, extend the span */
+				sb = sb ?: line;
+				se = line + nrd;
+				continue;
+			}
+			obuf_add(ob, line, coff[ncol] - 1U);
+			obuf_add(ob, res, nhof - ncol + 1U);
+		}
+		if (sb != NULL) {
+			obuf_ref(ob, sb, se - sb);
 		}
 	}
 	return rc;
@@ -236,7 +233,7 @@ Error: line %zu has fewer than %zu columns", nr, ncol);
 non_triv:
 	with (size_t coff[ncol + 1U]) {
 		size_t nr = 1U;
-		while ((nrd = getline(&line, &llen, fp)) > 0) {
+		while ((nrd = rdln_getln(&line, rd)) > 0) {
 			nr++;
 			if (UNLIKELY(tokln1(coff, ncol, line, nrd) < ncol)) {
 				errno = 0, error("\
@@ -251,9 +248,9 @@ Error: line %zu has fewer than %zu columns", nr, ncol);
 					const char *bo = line + coff[j + 0U];
 					const char *eo = line + coff[j + 1U];
 
-					fwrite(bo, 1, eo - bo - 1U, stdout);
+					obuf_add(ob, bo, eo - bo - 1U);
 				}
-				fputc('\t' + (i + 1U >= nhof), stdout);
+				obuf_chr(ob, '\t' + (i + 1U >= nhof));
 			}
 		}
 	}
@@ -267,16 +264,24 @@ int
 main(int argc, char *argv[])
 {
 	static yuck_t argi[1U];
-	FILE **fps;
+	int *fds;
+	rdln_t *rds;
 	int rc = 0;
 
 	if (yuck_parse(argi, argc, argv) < 0) {
 		rc = 1;
 		goto out;
 	}
+	if (UNLIKELY((ob = obuf_open(STDOUT_FILENO)) == NULL)) {
+		error("\
+Error: cannot set up output buffer");
+		rc = 1;
+		goto out;
+	}
 
 	/* we're oper'ing on descriptors */
-	if (UNLIKELY((fps = calloc(argi->nargs, sizeof(*fps))) == NULL)) {
+	if (UNLIKELY((fds = calloc(argi->nargs, sizeof(*fds))) == NULL ||
+		     (rds = calloc(argi->nargs, sizeof(*rds))) == NULL)) {
 		error("\
 Error: cannot allocate space for file descriptors");
 		rc = 1;
@@ -309,10 +314,11 @@ Error: cannot allocate space for header permutation");
 
 	/* snarf headers from files */
 	for (size_t i = 0U; i < argi->nargs; i++) {
-		if (UNLIKELY((fps[i] = fopen(argi->args[i], "r")) == NULL)) {
+		if (UNLIKELY((fds[i] = open(argi->args[i], O_RDONLY)) < 0 ||
+			     (rds[i] = rdln_open(fds[i])) == NULL)) {
 			error("\
 Error: cannot open file `%s'", argi->args[i]);
-		} else if (UNLIKELY(proc_hdr(fps[i]) < 0)) {
+		} else if (UNLIKELY(proc_hdr(rds[i]) < 0)) {
 			error("\
 Warning: header unreadable in file `%s'", argi->args[i]);
 		}
@@ -320,28 +326,33 @@ Warning: header unreadable in file `%s'", argi->args[i]);
 
 	if (argi->col_names_flag && nhdr) {
 		hdr[nhdr - 1U] = '\n';
-		fwrite(hdr + 1U, 1, nhdr - 1U, stdout);
+		obuf_add(ob, hdr + 1U, nhdr - 1U);
 	}
 
 	/* snarf residuals */
 	for (size_t i = 0U; i < argi->nargs; i++) {
-		rc |= proc_res(fps[i]) < 0;
+		rc |= proc_res(rds[i]) < 0;
 	}
 
+	/* references into the files must be written before unmapping */
+	obuf_flush(ob);
 	/* release handles (again?) */
 	for (size_t i = 0U; i < argi->nargs; i++) {
-		if (fps[i]) {
-			fclose(fps[i]);
+		rdln_close(rds[i]);
+		if (fds[i] >= 0) {
+			close(fds[i]);
 		}
 	}
-	free(fps);
+	free(fds);
+	free(rds);
 	free(hdr);
 	free(hof);
 	free(perm);
-	/* line buffer */
-	free(line);
 
 out:
+	if (UNLIKELY(obuf_close(ob) < 0)) {
+		rc = 1;
+	}
 	yuck_free(argi);
 	return rc;
 }
@@ -0,0 +1,151 @@
+/*** hash.h -- hashing of keys
+ *
+ * Copyright (C) 2017-2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_hash_h_
+#define INCLUDED_hash_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HASHSIZE	(64U / 8U)
+
+extern uint64_t MurmurHash64A(const void *key, size_t len, uint64_t seed);
+
+/* wyhash, the 64bit multiply-and-fold family, with the short key path
+ * done in two overlapping unaligned loads instead of a byte-wise tail */
+static const uint64_t wysecret_[4U] = {
+	0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+	0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL,
+};
+
+static inline void
+wymum_(uint64_t *restrict a, uint64_t *restrict b)
+{
+#if defined __SIZEOF_INT128__
+	__uint128_t r = *a;
+	r *= *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64U);
+#else  /* !__SIZEOF_INT128__ */
+	const uint64_t ha = *a >> 32U, hb = *b >> 32U;
+	const uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+	const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	const uint64_t t = rl + (rm0 << 32U);
+	uint64_t c = t < rl;
+	const uint64_t lo = t + (rm1 << 32U);
+
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32U) + (rm1 >> 32U) + c;
+#endif	/* __SIZEOF_INT128__ */
+	return;
+}
+
+static inline uint64_t
+wymix_(uint64_t a, uint64_t b)
+{
+	wymum_(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t
+wyr8_(const unsigned char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t
+wyr4_(const unsigned char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t
+wyhash64(const void *key, size_t len, uint64_t seed)
+{
+	const unsigned char *p = key;
+	uint64_t a, b;
+
+	seed ^= wymix_(seed ^ wysecret_[0U], wysecret_[1U]);
+	if (__builtin_expect(len <= 16U, 1)) {
+		if (__builtin_expect(len >= 4U, 1)) {
+			const unsigned char *const q = p + len - 4U;
+			const size_t o = (len >> 3U) << 2U;
+			a = (wyr4_(p) << 32U) | wyr4_(p + o);
+			b = (wyr4_(q) << 32U) | wyr4_(q - o);
+		} else if (__builtin_expect(len > 0U, 1)) {
+			a = ((uint64_t)p[0U] << 16U) |
+				((uint64_t)p[len >> 1U] << 8U) | p[len - 1U];
+			b = 0U;
+		} else {
+			a = b = 0U;
+		}
+	} else {
+		size_t i = len;
+
+		for (; i > 16U; i -= 16U, p += 16U) {
+			seed = wymix_(wyr8_(p) ^ wysecret_[1U],
+				      wyr8_(p + 8U) ^ seed);
+		}
+		a = wyr8_(p + i - 16U);
+		b = wyr8_(p + i - 8U);
+	}
+	a ^= wysecret_[1U];
+	b ^= seed;
+	wymum_(&a, &b);
+	return wymix_(a ^ wysecret_[0U] ^ len, b ^ wysecret_[1U]);
+}
+
+#if defined WITH_MURMUR_HASH
+# define hash(x, y)	MurmurHash64A((x), (y), 0UL)
+# define hash2(x, y, z)	MurmurHash64A((x), (y), (z))
+#else  /* !WITH_MURMUR_HASH */
+# define hash(x, y)	wyhash64((x), (y), 0UL)
+# define hash2(x, y, z)	wyhash64((x), (y), (z))
+#endif	/* WITH_MURMUR_HASH */
+
+/**
+ * Combine hash D of the keys so far with key X of length Y.
+ * Unlike xor-ing individual hashes this depends on the order of keys,
+ * and equal keys don't cancel each other out. */
+#define hashc(d, x, y)	hash2((x), (y), (d))
+
+#endif	/* INCLUDED_hash_h_ */
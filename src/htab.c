@@ -0,0 +1,133 @@
+/*** htab.c -- open-addressing hash index
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "htab.h"
+#include "nifty.h"
+
+#define HTAB_MINZ	(64U)
+
+
+static void
+htab_ins(struct htab_s *restrict h, uint64_t k, size_t v)
+{
+	const size_t m = h->z - 1U;
+	size_t i;
+
+	for (i = htab_home(h, k); h->v[i] != HTAB_NIL; i = (i + 1U) & m);
+	h->k[i] = k;
+	h->v[i] = v;
+	return;
+}
+
+static int
+htab_grow(struct htab_s *restrict h)
+{
+	const struct htab_s o = *h;
+
+	if (UNLIKELY(htab_init(h, o.z * 2U) < 0)) {
+		*h = o;
+		return -1;
+	}
+	for (size_t i = 0U; i < o.z; i++) {
+		if (o.v[i] != HTAB_NIL) {
+			htab_ins(h, o.k[i], o.v[i]);
+		}
+	}
+	h->n = o.n;
+	free(o.k);
+	free(o.v);
+	return 0;
+}
+
+
+int
+htab_init(struct htab_s *restrict h, size_t z)
+{
+	for (h->z = HTAB_MINZ; h->z < z; h->z *= 2U);
+	h->n = 0U;
+	h->k = malloc(h->z * sizeof(*h->k));
+	h->v = malloc(h->z * sizeof(*h->v));
+	if (UNLIKELY(h->k == NULL || h->v == NULL)) {
+		free(h->k);
+		free(h->v);
+		h->k = NULL;
+		h->v = NULL;
+		h->z = 0U;
+		return -1;
+	}
+	memset(h->v, -1, h->z * sizeof(*h->v));
+	return 0;
+}
+
+void
+htab_fini(struct htab_s *restrict h)
+{
+	free(h->k);
+	free(h->v);
+	h->k = NULL;
+	h->v = NULL;
+	h->z = h->n = 0U;
+	return;
+}
+
+void
+htab_clear(struct htab_s *restrict h)
+{
+	memset(h->v, -1, h->z * sizeof(*h->v));
+	h->n = 0U;
+	return;
+}
+
+int
+htab_put(struct htab_s *restrict h, uint64_t k, size_t v)
+{
+	if (UNLIKELY(!h->z && htab_init(h, HTAB_MINZ) < 0)) {
+		return -1;
+	} else if (UNLIKELY(2U * (h->n + 1U) > h->z && htab_grow(h) < 0)) {
+		return -1;
+	}
+	htab_ins(h, k, v);
+	h->n++;
+	return 0;
+}
+
+/* htab.c ends here */
@@ -0,0 +1,104 @@
+/*** htab.h -- open-addressing hash index
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_htab_h_
+#define INCLUDED_htab_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Map 64-bit hash values to indices (into some user array).
+ * Keys need not be unique, colliding entries can be iterated over
+ * with htab_next().  Linear probing, the table is kept at most half
+ * full. */
+struct htab_s {
+	/* number of slots, a power of 2 */
+	size_t z;
+	/* number of entries */
+	size_t n;
+	uint64_t *k;
+	size_t *v;
+};
+
+#define HTAB_NIL	((size_t)-1)
+
+extern int htab_init(struct htab_s *restrict h, size_t z);
+extern void htab_fini(struct htab_s *restrict h);
+extern void htab_clear(struct htab_s *restrict h);
+
+/**
+ * Add mapping K -> V to H.  V must not be HTAB_NIL. */
+extern int htab_put(struct htab_s *restrict h, uint64_t k, size_t v);
+
+
+static inline size_t
+htab_home(const struct htab_s *h, uint64_t k)
+{
+/* fibonacci hashing, so weak hashes are spread as well */
+	return (size_t)((k * 0x9e3779b97f4a7c15ULL) >> 32U) & (h->z - 1U);
+}
+
+/**
+ * Return the next value stored under K, starting the probe at slot *P
+ * which should be initialised with htab_home(K).
+ * Return HTAB_NIL if there are no further values. */
+static inline size_t
+htab_next(const struct htab_s *h, uint64_t k, size_t *restrict p)
+{
+	const size_t m = h->z - 1U;
+
+	if (__builtin_expect(!h->z, 0)) {
+		return HTAB_NIL;
+	}
+	for (size_t i = *p & m; h->v[i] != HTAB_NIL; i = (i + 1U) & m) {
+		if (h->k[i] == k) {
+			*p = i + 1U;
+			return h->v[i];
+		}
+	}
+	return HTAB_NIL;
+}
+
+/**
+ * Return the first value stored under K or HTAB_NIL. */
+static inline size_t
+htab_get(const struct htab_s *h, uint64_t k)
+{
+	size_t p = htab_home(h, k);
+	return htab_next(h, k, &p);
+}
+
+#endif	/* INCLUDED_htab_h_ */
@@ -0,0 +1,180 @@
+/*** key.c -- order preserving binary keys
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "key.h"
+#include "nifty.h"
+
+/* tags of numeric columns, in order */
+enum {
+	KEY_TNEG = 0x01U,
+	KEY_TZRO,
+	KEY_TPOS,
+	/* not a number, empty or not, sorts last */
+	KEY_TSTR,
+};
+
+/* exponents are clamped to this */
+#define KEY_MAXE	(32767L)
+
+static inline bool
+digp(char c)
+{
+	return (unsigned char)(c ^ '0') < 10U;
+}
+
+
+size_t
+key_num(unsigned char *restrict tgt, const char *s, size_t z)
+{
+/* [-+]D*[.D*][(e|E)[-+]D+] with at least one digit in the mantissa,
+ * as tag, 2 byte exponent E and significant digits D... so that the
+ * number is 0.D... * 10^E, for negative numbers all bytes after the
+ * tag are inverted, so the longer the mantissa the smaller */
+	const char *const ep = s + z;
+	const char *p = s;
+	const char *ip, *ie, *fp, *fe;
+	bool neg = false;
+	long int x = 0;
+	size_t n;
+
+	if (UNLIKELY(!z)) {
+		goto str;
+	}
+	if (*p == '-' || *p == '+') {
+		neg = *p++ == '-';
+	}
+	for (ip = p; p < ep && digp(*p); p++);
+	ie = fp = fe = p;
+	if (p < ep && *p == '.') {
+		for (fp = ++p; p < ep && digp(*p); p++);
+		fe = p;
+	}
+	if (UNLIKELY(ip == ie && fp == fe)) {
+		goto str;
+	}
+	if (p < ep && (*p == 'e' || *p == 'E')) {
+		bool eneg = false;
+
+		if (++p < ep && (*p == '-' || *p == '+')) {
+			eneg = *p++ == '-';
+		}
+		if (UNLIKELY(p >= ep || !digp(*p))) {
+			goto str;
+		}
+		for (; p < ep && digp(*p); p++) {
+			x = x < KEY_MAXE ? x * 10 + (*p ^ '0') : x;
+		}
+		x = eneg ? -x : x;
+	}
+	if (UNLIKELY(p < ep)) {
+		goto str;
+	}
+
+	/* leading zeros don't count */
+	for (p = ip; p < ie && *p == '0'; p++);
+	if (p == ie) {
+		for (p = fp; p < fe && *p == '0'; p++);
+		if (p == fe) {
+			tgt[0U] = KEY_TZRO;
+			return 1U;
+		}
+		x -= p - fp;
+	} else {
+		x += ie - p;
+	}
+	x = x < -KEY_MAXE ? -KEY_MAXE : x > KEY_MAXE ? KEY_MAXE : x;
+
+	/* significant digits, trailing zeros don't count either */
+	n = 3U;
+	for (size_t m = n; p < fe; p++) {
+		if (p == ie) {
+			p = fp;
+			if (p >= fe) {
+				break;
+			}
+		}
+		tgt[m++] = (unsigned char)*p;
+		n = *p != '0' ? m : n;
+	}
+	with (unsigned int e = (unsigned int)(x + KEY_MAXE + 1L)) {
+		tgt[0U] = neg ? KEY_TNEG : KEY_TPOS;
+		tgt[1U] = (unsigned char)(e >> 8U);
+		tgt[2U] = (unsigned char)(e >> 0U);
+	}
+	tgt[n++] = '\0';
+	if (neg) {
+		for (size_t i = 1U; i < n; i++) {
+			tgt[i] = (unsigned char)~tgt[i];
+		}
+	}
+	return n;
+
+str:
+	tgt[0U] = KEY_TSTR;
+	memcpy(tgt + 1U, s, z);
+	tgt[z + 1U] = '\0';
+	return z + 2U;
+}
+
+keycmp_t*
+key_form(const char *f, size_t z)
+{
+	const char *const ef = f + z;
+	keycmp_t *r;
+	size_t n = 1U;
+
+	for (const char *p = f; (p = memchr(p, '+', ef - p)); p++, n++);
+	if (UNLIKELY((r = malloc(n * sizeof(*r))) == NULL)) {
+		return NULL;
+	}
+	for (size_t i = 0U; i < n; i++) {
+		const char *const on = memchr(f, '+', ef - f) ?: ef;
+		const char *e = on;
+
+		r[i] = key_sfx(f, &e);
+		f = on + 1U;
+	}
+	return r;
+}
+
+/* key.c ends here */
@@ -0,0 +1,151 @@
+/*** key.h -- order preserving binary keys
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_key_h_
+#define INCLUDED_key_h_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Keys are the join columns of a line encoded such that memcmp(3)
+ * orders them like comparing column by column would, lexicographically
+ * or numerically as per the column's comparator.  Lexicographic columns
+ * are NUL terminated, numeric ones are a sign tag, a biased exponent
+ * and the significant digits, so 9 < 10 and 1.0 == 1.
+ * The first 8 bytes, read big-endian, make up the prefix which settles
+ * most comparisons in one go. */
+typedef enum {
+	KEY_LEX,
+	KEY_NUM,
+} keycmp_t;
+
+struct key_s {
+	uint64_t pfx;
+	size_t z;
+	const unsigned char *k;
+};
+
+/* upper bound of the encoded size of a column of size Z */
+#define KEY_ENCZ(z)	((z) + 4U)
+
+/**
+ * Encode S of size Z as number into TGT, return the encoded size. */
+extern size_t key_num(unsigned char *restrict tgt, const char *s, size_t z);
+
+/**
+ * Return the comparators of the `+'-separated terms of formula F of
+ * size Z, see key_sfx(), or NULL if out of memory. */
+extern keycmp_t *key_form(const char *f, size_t z);
+
+
+/**
+ * Return the comparator of formula term [S, *E), `:n' at the end of a
+ * term means numeric, and set *E to the end of the term proper. */
+static inline keycmp_t
+key_sfx(const char *s, const char **e)
+{
+	const char *p = *e;
+
+	for (; p > s && (unsigned char)(p[-1] - 1) < ' '; p--);
+	if (p - s >= 2 && p[-2] == ':' && p[-1] == 'n') {
+		*e = p - 2;
+		return KEY_NUM;
+	}
+	return KEY_LEX;
+}
+
+/**
+ * Encode S of size Z as per comparator C into TGT, which must have room
+ * for KEY_ENCZ(Z) bytes, return the encoded size. */
+static inline size_t
+key_enc(unsigned char *restrict tgt, keycmp_t c, const char *s, size_t z)
+{
+	if (c == KEY_NUM) {
+		return key_num(tgt, s, z);
+	}
+	memcpy(tgt, s, z);
+	tgt[z] = '\0';
+	return z + 1U;
+}
+
+/**
+ * Return the prefix of the encoded key K of size Z. */
+static inline uint64_t
+key_pfx(const unsigned char *k, size_t z)
+{
+	uint64_t v = 0U;
+
+	memcpy(&v, k, z < sizeof(v) ? z : sizeof(v));
+#if defined __BYTE_ORDER__ && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif	/* little endian */
+	return v;
+}
+
+static inline int
+key_cmp(const struct key_s *a, const struct key_s *b)
+{
+	const size_t z = a->z < b->z ? a->z : b->z;
+	const size_t w = sizeof(a->pfx);
+
+	if (a->pfx != b->pfx) {
+		return a->pfx < b->pfx ? -1 : 1;
+	}
+	/* go on word by word, the last word may overlap the one before */
+	for (size_t i = w; i < z; i += w) {
+		const size_t o = i + w <= z ? i : z - w;
+		const uint64_t x = key_pfx(a->k + o, w);
+		const uint64_t y = key_pfx(b->k + o, w);
+
+		if (x != y) {
+			return x < y ? -1 : 1;
+		}
+	}
+	return (a->z > b->z) - (a->z < b->z);
+}
+
+static inline bool
+key_eq(const struct key_s *a, const struct key_s *b)
+{
+	return a->pfx == b->pfx && a->z == b->z &&
+		(a->z <= sizeof(a->pfx) ||
+		 !memcmp(a->k + sizeof(a->pfx), b->k + sizeof(b->pfx),
+			 a->z - sizeof(a->pfx)));
+}
+
+#endif	/* INCLUDED_key_h_ */
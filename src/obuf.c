@@ -0,0 +1,249 @@
+/*** obuf.c -- buffered output with writev(2) flushes
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include "obuf.h"
+#include "nifty.h"
+
+#if !defined IOV_MAX
+# define IOV_MAX	(1024)
+#endif	/* !IOV_MAX */
+
+/* size of the copy buffer */
+#if !defined OBUF_BUFZ
+# define OBUF_BUFZ	(256U << 10U)
+#endif	/* !OBUF_BUFZ */
+/* number of iovecs to gather before flushing */
+#define OBUF_NIOV	(IOV_MAX)
+/* spans shorter than this are copied rather than referenced */
+#define OBUF_MINREF	(64U)
+
+
+static void
+obuf_seal(obuf_t o)
+{
+/* cover the not yet gathered part of the copy buffer by an iovec */
+	if (o->bi > o->bc) {
+		const char *bp = o->buf + o->bc;
+		struct iovec *v = o->iov + o->niov;
+
+		if (o->niov && (char*)v[-1].iov_base + v[-1].iov_len == bp) {
+			/* coalesce */
+			v[-1].iov_len += o->bi - o->bc;
+		} else {
+			*v = (struct iovec){(void*)deconst(bp), o->bi - o->bc};
+			o->niov++;
+		}
+		o->bc = o->bi;
+	}
+	return;
+}
+
+static int
+obuf_writev(obuf_t o)
+{
+	struct iovec *v = o->iov;
+	size_t n = o->niov;
+
+	while (n) {
+		ssize_t nwr = writev(o->fd, v, n < IOV_MAX ? n : IOV_MAX);
+
+		if (UNLIKELY(nwr < 0 && errno == EINTR)) {
+			continue;
+		} else if (UNLIKELY(nwr < 0)) {
+			o->errp = 1;
+			return -1;
+		}
+		/* skip over everything that made it */
+		for (; n && (size_t)nwr >= v->iov_len; n--) {
+			nwr -= (v++)->iov_len;
+		}
+		if (n) {
+			v->iov_base = (char*)v->iov_base + nwr;
+			v->iov_len -= nwr;
+		}
+	}
+	return 0;
+}
+
+static int
+obuf_room(obuf_t o, size_t z)
+{
+/* make sure there's room for Z more bytes in the copy buffer */
+	size_t nuz;
+	char *nub;
+
+	if (o->fd >= 0) {
+		obuf_flush(o);
+	}
+	if (LIKELY(o->bz - o->bi >= z)) {
+		return 0;
+	}
+	/* no iovecs point into the buffer anymore, so we may move it */
+	for (nuz = o->bz * 2U; nuz - o->bi < z; nuz *= 2U);
+	if (UNLIKELY((nub = realloc(o->buf, nuz)) == NULL)) {
+		o->errp = 1;
+		return -1;
+	}
+	o->buf = nub;
+	o->bz = nuz;
+	return 0;
+}
+
+
+obuf_t
+obuf_open(int fd)
+{
+	struct obuf_s *o;
+
+	if (UNLIKELY((o = calloc(1U, sizeof(*o))) == NULL)) {
+		return NULL;
+	} else if (UNLIKELY((o->buf = malloc(o->bz = OBUF_BUFZ)) == NULL)) {
+		goto nul;
+	}
+	if ((o->fd = fd) < 0) {
+		/* memory-only buffers don't need a gather list */
+		return o;
+	} else if (UNLIKELY((o->iov = malloc(
+				     (o->ziov = OBUF_NIOV) *
+				     sizeof(*o->iov))) == NULL)) {
+		free(o->buf);
+		goto nul;
+	}
+	return o;
+nul:
+	free(o);
+	return NULL;
+}
+
+int
+obuf_close(obuf_t o)
+{
+	int rc;
+
+	if (UNLIKELY(o == NULL)) {
+		return 0;
+	}
+	obuf_flush(o);
+	rc = -o->errp;
+	free(o->iov);
+	free(o->buf);
+	free(o);
+	return rc;
+}
+
+int
+obuf_flush(obuf_t o)
+{
+	if (o->fd < 0) {
+		return 0;
+	}
+	obuf_seal(o);
+	obuf_writev(o);
+	o->niov = 0U;
+	o->bi = o->bc = 0U;
+	return -o->errp;
+}
+
+const char*
+obuf_data(obuf_t o, size_t *z)
+{
+	*z = o->bi;
+	o->bi = o->bc = 0U;
+	return o->buf;
+}
+
+void
+obuf_ref(obuf_t o, const char *s, size_t z)
+{
+	if (o->fd < 0 || z < OBUF_MINREF) {
+		obuf_add(o, s, z);
+		return;
+	} else if (UNLIKELY(o->niov + 3U > o->ziov)) {
+		/* room for a sealed copy region, S and a final seal */
+		obuf_flush(o);
+	}
+	obuf_seal(o);
+	o->iov[o->niov++] = (struct iovec){(void*)deconst(s), z};
+	return;
+}
+
+int
+obuf_fmt(obuf_t o, const char *fmt, ...)
+{
+	va_list vap;
+	int n;
+
+	va_start(vap, fmt);
+	n = vsnprintf(o->buf + o->bi, o->bz - o->bi, fmt, vap);
+	va_end(vap);
+	if (UNLIKELY(n < 0)) {
+		return -1;
+	} else if (UNLIKELY((size_t)n >= o->bz - o->bi)) {
+		/* make room and reprint */
+		if (UNLIKELY(obuf_room(o, n + 1U) < 0)) {
+			return -1;
+		}
+		va_start(vap, fmt);
+		vsnprintf(o->buf + o->bi, o->bz - o->bi, fmt, vap);
+		va_end(vap);
+	}
+	o->bi += n;
+	return n;
+}
+
+void
+obuf_add_slow(obuf_t o, const char *s, size_t z)
+{
+	if (UNLIKELY(obuf_room(o, z) < 0)) {
+		return;
+	}
+	memcpy(o->buf + o->bi, s, z);
+	o->bi += z;
+	return;
+}
+
+/* obuf.c ends here */
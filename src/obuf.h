@@ -0,0 +1,133 @@
+/*** obuf.h -- buffered output with writev(2) flushes
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_obuf_h_
+#define INCLUDED_obuf_h_
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/uio.h>
+
+typedef struct obuf_s *obuf_t;
+
+struct obuf_s {
+	/* descriptor to flush to, or -1 for memory-only buffers */
+	int fd;
+	int errp;
+	/* copy buffer */
+	char *buf;
+	size_t bz;
+	size_t bi;
+	/* part of BUF up to here is already covered by IOV */
+	size_t bc;
+	/* gather list */
+	struct iovec *iov;
+	size_t niov;
+	size_t ziov;
+};
+
+/**
+ * Set up an output buffer flushing to descriptor FD.
+ * For FD < 0 the buffer lives in memory only and grows as needed,
+ * its contents are available via obuf_data(). */
+extern obuf_t obuf_open(int fd);
+
+/**
+ * Flush and release output buffer O.
+ * Return -1 if any write to O's descriptor failed. */
+extern int obuf_close(obuf_t o);
+
+/**
+ * Write everything gathered so far to O's descriptor.
+ * For memory-only buffers this is a no-op. */
+extern int obuf_flush(obuf_t o);
+
+/**
+ * Reset memory-only buffer O, returning its contents and size in *Z. */
+extern const char *obuf_data(obuf_t o, size_t *z);
+
+/**
+ * Gather Z bytes at S without copying them.
+ * S must stay valid until the next explicit obuf_flush().
+ * Memory-only buffers copy S. */
+extern void obuf_ref(obuf_t o, const char *s, size_t z);
+
+/**
+ * Append formatted output. */
+extern int obuf_fmt(obuf_t o, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* slow paths of the inlines below */
+extern void obuf_add_slow(obuf_t o, const char *s, size_t z);
+
+
+/**
+ * Append a copy of the Z bytes at S. */
+static inline void
+obuf_add(obuf_t o, const char *s, size_t z)
+{
+	if (__builtin_expect(o->bi + z > o->bz, 0)) {
+		obuf_add_slow(o, s, z);
+		return;
+	}
+	memcpy(o->buf + o->bi, s, z);
+	o->bi += z;
+	return;
+}
+
+/**
+ * Append character C. */
+static inline void
+obuf_chr(obuf_t o, char c)
+{
+	if (__builtin_expect(o->bi >= o->bz, 0)) {
+		obuf_add_slow(o, &c, 1U);
+		return;
+	}
+	o->buf[o->bi++] = c;
+	return;
+}
+
+/**
+ * Append the string S. */
+static inline void
+obuf_str(obuf_t o, const char *s)
+{
+	obuf_add(o, s, strlen(s));
+	return;
+}
+
+#endif	/* INCLUDED_obuf_h_ */
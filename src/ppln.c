@@ -0,0 +1,349 @@
+/*** ppln.c -- ordered pipeline of worker threads
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#if defined HAVE_PTHREAD
+# include <pthread.h>
+#endif	/* HAVE_PTHREAD */
+#include "ppln.h"
+#include "obuf.h"
+#include "nifty.h"
+
+#if defined HAVE_PTHREAD
+struct slot_s {
+	enum {
+		SLOT_FREE,
+		SLOT_FULL,
+		SLOT_BUSY,
+		SLOT_DONE,
+	} st;
+	int rc;
+	const char *buf;
+	size_t bz;
+	size_t tag;
+	/* BUF if it's ours to free */
+	char *own;
+	obuf_t o;
+};
+
+struct ppln_s {
+	pthread_mutex_t mtx;
+	/* signalled when slots become free, full or done respectively */
+	pthread_cond_t cv_free;
+	pthread_cond_t cv_full;
+	pthread_cond_t cv_done;
+
+	ppln_work_f work;
+	void *const *wst;
+	obuf_t out;
+
+	/* chunks pushed, claimed by workers, and written so far,
+	 * chunk N lives in slot N % NSLOT */
+	size_t npsh;
+	size_t nclm;
+	size_t nwrt;
+	int eofp;
+	int rc;
+
+	size_t nwrk;
+	pthread_t *wrk;
+	pthread_t wrt;
+
+	size_t nslot;
+	struct slot_s slot[];
+};
+
+struct wcl_s {
+	struct ppln_s *p;
+	size_t i;
+};
+
+
+static void*
+wrkr(void *clo)
+{
+	struct ppln_s *p = ((struct wcl_s*)clo)->p;
+	void *wst = p->wst[((struct wcl_s*)clo)->i];
+
+	free(clo);
+	pthread_mutex_lock(&p->mtx);
+	while (1) {
+		struct slot_s *s;
+
+		while (p->nclm >= p->npsh && !p->eofp) {
+			pthread_cond_wait(&p->cv_full, &p->mtx);
+		}
+		if (p->nclm >= p->npsh) {
+			/* nothing left to claim */
+			break;
+		}
+		s = p->slot + p->nclm++ % p->nslot;
+		s->st = SLOT_BUSY;
+		pthread_mutex_unlock(&p->mtx);
+
+		s->rc = p->work(wst, s->o, s->buf, s->bz, s->tag);
+
+		pthread_mutex_lock(&p->mtx);
+		s->st = SLOT_DONE;
+		pthread_cond_broadcast(&p->cv_done);
+	}
+	pthread_mutex_unlock(&p->mtx);
+	return NULL;
+}
+
+static void*
+wrtr(void *clo)
+{
+	struct ppln_s *p = clo;
+
+	pthread_mutex_lock(&p->mtx);
+	while (1) {
+		struct slot_s *s = p->slot + p->nwrt % p->nslot;
+		const char *d;
+		size_t z;
+
+		while (!(p->nwrt < p->npsh && s->st == SLOT_DONE)) {
+			if (p->nwrt >= p->npsh && p->eofp) {
+				goto out;
+			}
+			pthread_cond_wait(&p->cv_done, &p->mtx);
+		}
+		pthread_mutex_unlock(&p->mtx);
+
+		d = obuf_data(s->o, &z);
+		if (LIKELY(!p->rc)) {
+			obuf_add(p->out, d, z);
+		}
+		free(s->own);
+		s->own = NULL;
+		s->buf = NULL;
+
+		pthread_mutex_lock(&p->mtx);
+		if (UNLIKELY(s->rc && !p->rc)) {
+			/* emit nothing after this one */
+			p->rc = s->rc;
+		}
+		s->st = SLOT_FREE;
+		p->nwrt++;
+		pthread_cond_broadcast(&p->cv_free);
+	}
+out:
+	pthread_mutex_unlock(&p->mtx);
+	return NULL;
+}
+
+
+ppln_t
+ppln_open(size_t nwrk, ppln_work_f work, void *const *wst, obuf_t out)
+{
+	/* enough slots to keep everyone busy while the writer lags */
+	const size_t nslot = 2U * nwrk + 2U;
+	struct ppln_s *p;
+	size_t i;
+
+	if (UNLIKELY(!nwrk)) {
+		return NULL;
+	}
+	p = calloc(1U, sizeof(*p) + nslot * sizeof(*p->slot));
+	if (UNLIKELY(p == NULL)) {
+		return NULL;
+	}
+	p->work = work;
+	p->wst = wst;
+	p->out = out;
+	p->nslot = nslot;
+	for (i = 0U; i < nslot; i++) {
+		if (UNLIKELY((p->slot[i].o = obuf_open(-1)) == NULL)) {
+			goto nomem;
+		}
+	}
+	if (UNLIKELY((p->wrk = calloc(nwrk, sizeof(*p->wrk))) == NULL)) {
+		goto nomem;
+	}
+	pthread_mutex_init(&p->mtx, NULL);
+	pthread_cond_init(&p->cv_free, NULL);
+	pthread_cond_init(&p->cv_full, NULL);
+	pthread_cond_init(&p->cv_done, NULL);
+
+	if (UNLIKELY(pthread_create(&p->wrt, NULL, wrtr, p))) {
+		pthread_cond_destroy(&p->cv_done);
+		pthread_cond_destroy(&p->cv_full);
+		pthread_cond_destroy(&p->cv_free);
+		pthread_mutex_destroy(&p->mtx);
+		goto nomem;
+	}
+	for (; p->nwrk < nwrk; p->nwrk++) {
+		struct wcl_s *c = malloc(sizeof(*c));
+
+		if (UNLIKELY(c == NULL)) {
+			break;
+		}
+		*c = (struct wcl_s){p, p->nwrk};
+		if (UNLIKELY(pthread_create(p->wrk + p->nwrk, NULL, wrkr, c))) {
+			free(c);
+			break;
+		}
+	}
+	if (UNLIKELY(!p->nwrk)) {
+		/* not a single worker, tear down the writer */
+		ppln_close(p);
+		return NULL;
+	}
+	return p;
+
+nomem:
+	for (i = 0U; i < nslot; i++) {
+		obuf_close(p->slot[i].o);
+	}
+	free(p->wrk);
+	free(p);
+	return NULL;
+}
+
+static int
+push(ppln_t p, const char *buf, size_t bz, size_t tag, char *own)
+{
+	struct slot_s *s;
+	int rc;
+
+	pthread_mutex_lock(&p->mtx);
+	s = p->slot + p->npsh % p->nslot;
+	while (s->st != SLOT_FREE && !p->rc) {
+		pthread_cond_wait(&p->cv_free, &p->mtx);
+	}
+	if (UNLIKELY((rc = p->rc))) {
+		pthread_mutex_unlock(&p->mtx);
+		free(own);
+		return rc;
+	}
+	s->st = SLOT_FULL;
+	s->buf = buf;
+	s->bz = bz;
+	s->tag = tag;
+	s->own = own;
+	p->npsh++;
+	pthread_cond_signal(&p->cv_full);
+	pthread_mutex_unlock(&p->mtx);
+	return 0;
+}
+
+int
+ppln_push(ppln_t p, char *buf, size_t bz, size_t tag)
+{
+	return push(p, buf, bz, tag, buf);
+}
+
+int
+ppln_lend(ppln_t p, const char *buf, size_t bz, size_t tag)
+{
+	return push(p, buf, bz, tag, NULL);
+}
+
+int
+ppln_close(ppln_t p)
+{
+	int rc;
+
+	pthread_mutex_lock(&p->mtx);
+	p->eofp = 1;
+	pthread_cond_broadcast(&p->cv_full);
+	pthread_cond_broadcast(&p->cv_done);
+	pthread_mutex_unlock(&p->mtx);
+
+	for (size_t i = 0U; i < p->nwrk; i++) {
+		pthread_join(p->wrk[i], NULL);
+	}
+	pthread_join(p->wrt, NULL);
+
+	pthread_cond_destroy(&p->cv_free);
+	pthread_cond_destroy(&p->cv_full);
+	pthread_cond_destroy(&p->cv_done);
+	pthread_mutex_destroy(&p->mtx);
+
+	rc = p->rc;
+	for (size_t i = 0U; i < p->nslot; i++) {
+		free(p->slot[i].own);
+		obuf_close(p->slot[i].o);
+	}
+	free(p->wrk);
+	free(p);
+	return rc;
+}
+
+#else  /* !HAVE_PTHREAD */
+ppln_t
+ppln_open(size_t nwrk, ppln_work_f work, void *const *wst, obuf_t out)
+{
+	(void)nwrk;
+	(void)work;
+	(void)wst;
+	(void)out;
+	return NULL;
+}
+
+int
+ppln_push(ppln_t p, char *buf, size_t bz, size_t tag)
+{
+	(void)p;
+	(void)bz;
+	(void)tag;
+	free(buf);
+	return -1;
+}
+
+int
+ppln_lend(ppln_t p, const char *buf, size_t bz, size_t tag)
+{
+	(void)p;
+	(void)buf;
+	(void)bz;
+	(void)tag;
+	return -1;
+}
+
+int
+ppln_close(ppln_t p)
+{
+	(void)p;
+	return -1;
+}
+#endif	/* HAVE_PTHREAD */
+
+/* ppln.c ends here */
@@ -0,0 +1,80 @@
+/*** ppln.h -- ordered pipeline of worker threads
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_ppln_h_
+#define INCLUDED_ppln_h_
+
+#include <stddef.h>
+#include "obuf.h"
+
+/* Chunks of input are handed to a pool of worker threads, each chunk
+ * is processed into a private output buffer, and a writer thread
+ * emits those buffers in the order the chunks were pushed. */
+typedef struct ppln_s *ppln_t;
+
+/**
+ * Process chunk BUF of size BZ into output buffer O.
+ * WST is the worker's private state, TAG what was given to ppln_push().
+ * A non-zero return value stops the pipeline after O has been emitted. */
+typedef int(*ppln_work_f)(void *wst, obuf_t o,
+			  const char *buf, size_t bz, size_t tag);
+
+/**
+ * Set up a pipeline of NWRK workers running WORK, worker I with state
+ * WST[I], and a writer thread appending to OUT.
+ * OUT must not be used by the caller until ppln_close().
+ * Return NULL if threads aren't supported or cannot be created. */
+extern ppln_t ppln_open(size_t nwrk, ppln_work_f work, void *const *wst,
+			obuf_t out);
+
+/**
+ * Hand chunk BUF of size BZ to the pipeline, blocks while all slots are
+ * in use.  BUF must be malloc()ed, the pipeline frees it.
+ * Return non-zero if the pipeline has been stopped, BUF is freed
+ * nonetheless. */
+extern int ppln_push(ppln_t p, char *buf, size_t bz, size_t tag);
+
+/**
+ * Like ppln_push() but BUF stays the caller's and must remain valid
+ * until ppln_close(). */
+extern int ppln_lend(ppln_t p, const char *buf, size_t bz, size_t tag);
+
+/**
+ * Wait for all chunks to be processed and emitted and tear down P.
+ * Return the first non-zero worker result, if any. */
+extern int ppln_close(ppln_t p);
+
+#endif	/* INCLUDED_ppln_h_ */
@@ -0,0 +1,276 @@
+/*** rdln.c -- block-buffered line reader
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "rdln.h"
+#include "nifty.h"
+
+#if !defined MAP_FAILED
+# define MAP_FAILED	((void*)-1)
+#endif	/* !MAP_FAILED */
+
+/* initial block size for non-mappable input */
+#if !defined RDLN_BLKZ
+# define RDLN_BLKZ	(1U << 20U)
+#endif	/* !RDLN_BLKZ */
+/* amount of read lines of a mapping to hold on to */
+#if !defined RDLN_DRPZ
+# define RDLN_DRPZ	(1U << 18U)
+#endif	/* !RDLN_DRPZ */
+
+struct rdln_s {
+	int fd;
+	unsigned int mapp:1;
+	unsigned int eofp:1;
+	/* where reading began, or -1 if FD isn't seekable */
+	off_t of0;
+	/* mapped file or read buffer */
+	char *buf;
+	size_t bsz;
+	/* for mappings the offset of BUF into the mapping */
+	size_t bof;
+	/* for mappings the offset up to which its pages were dropped */
+	size_t bd;
+	/* current line */
+	size_t bi;
+	/* offset up to which there's surely no newline */
+	size_t bs;
+	/* end of data in buffer */
+	size_t be;
+};
+
+
+static int
+rdln_mmap(struct rdln_s *restrict r)
+{
+	const size_t pgsz = sysconf(_SC_PAGESIZE);
+	struct stat st;
+	off_t of;
+	void *p;
+
+	if (UNLIKELY(fstat(r->fd, &st) < 0)) {
+		return -1;
+	} else if (!S_ISREG(st.st_mode)) {
+		return -1;
+	} else if ((of = lseek(r->fd, 0, SEEK_CUR)) < 0) {
+		return -1;
+	} else if (UNLIKELY(st.st_size <= of)) {
+		return -1;
+	} else if (UNLIKELY((uintmax_t)st.st_size > SIZE_MAX)) {
+		return -1;
+	}
+	/* mappings start at page boundaries */
+	r->bof = of % pgsz;
+	r->bsz = st.st_size - of + r->bof;
+	p = mmap(NULL, r->bsz, PROT_READ, MAP_PRIVATE, r->fd, of - r->bof);
+	if (UNLIKELY(p == MAP_FAILED)) {
+		return -1;
+	}
+#if defined MADV_SEQUENTIAL
+	(void)madvise(p, r->bsz, MADV_SEQUENTIAL);
+#endif	/* MADV_SEQUENTIAL */
+	r->buf = (char*)p + r->bof;
+	r->be = r->bsz - r->bof;
+	r->mapp = 1U;
+	r->eofp = 1U;
+	/* advance the descriptor like read(2) would have done */
+	(void)lseek(r->fd, 0, SEEK_END);
+	return 0;
+}
+
+static void
+rdln_drop(struct rdln_s *restrict r)
+{
+/* let go of the pages of lines read so far, they are read back from
+ * the file should someone still look at them, so lines stay valid */
+	const size_t pgsz = sysconf(_SC_PAGESIZE);
+	const size_t e = (r->bof + r->bi) / pgsz * pgsz;
+	char *const m = r->buf - r->bof;
+
+#if defined MADV_DONTNEED
+	(void)madvise(m + r->bd, e - r->bd, MADV_DONTNEED);
+#endif	/* MADV_DONTNEED */
+	r->bd = e;
+	return;
+}
+
+static ssize_t
+rdln_fill(struct rdln_s *restrict r)
+{
+/* move the incomplete line to the front and read another block */
+	ssize_t nrd;
+
+	if (r->bi) {
+		/* the only copy there is, for lines straddling blocks */
+		memmove(r->buf, r->buf + r->bi, r->be - r->bi);
+		r->bs -= r->bi;
+		r->be -= r->bi;
+		r->bi = 0U;
+	}
+	if (UNLIKELY(r->be >= r->bsz)) {
+		/* line longer than a block, double the buffer */
+		const size_t nuz = r->bsz * 2U;
+		char *nub = realloc(r->buf, nuz);
+
+		if (UNLIKELY(nub == NULL)) {
+			return -1;
+		}
+		r->buf = nub;
+		r->bsz = nuz;
+	}
+	do {
+		nrd = read(r->fd, r->buf + r->be, r->bsz - r->be);
+	} while (UNLIKELY(nrd < 0 && errno == EINTR));
+	if (nrd > 0) {
+		r->be += nrd;
+	} else if (!nrd) {
+		r->eofp = 1U;
+	}
+	return nrd;
+}
+
+
+rdln_t
+rdln_open(int fd)
+{
+	struct rdln_s *r;
+
+	if (UNLIKELY(fd < 0)) {
+		return NULL;
+	} else if (UNLIKELY((r = calloc(1U, sizeof(*r))) == NULL)) {
+		return NULL;
+	}
+	r->fd = fd;
+	r->of0 = lseek(fd, 0, SEEK_CUR);
+	if (rdln_mmap(r) < 0) {
+		/* go for the block buffer then */
+		if (UNLIKELY((r->buf = malloc(r->bsz = RDLN_BLKZ)) == NULL)) {
+			free(r);
+			return NULL;
+		}
+	}
+	return r;
+}
+
+void
+rdln_close(rdln_t r)
+{
+	if (UNLIKELY(r == NULL)) {
+		return;
+	} else if (r->mapp) {
+		munmap(r->buf - r->bof, r->bsz);
+	} else {
+		free(r->buf);
+	}
+	free(r);
+	return;
+}
+
+ssize_t
+rdln_getln(const char **ln, rdln_t r)
+{
+	const char *eol;
+	size_t eo;
+
+	while ((eol = memchr(r->buf + r->bs, '\n', r->be - r->bs)) == NULL) {
+		/* remember we've been here */
+		r->bs = r->be;
+		if (r->eofp) {
+			/* last line, without newline */
+			break;
+		} else if (UNLIKELY(rdln_fill(r) < 0)) {
+			return -1;
+		}
+	}
+	/* line spans [bi, eo) */
+	eo = eol ? (size_t)(eol + 1U - r->buf) : r->be;
+	if (UNLIKELY(eo <= r->bi)) {
+		/* nothing left */
+		return -1;
+	}
+	if (r->mapp && r->bof + r->bi >= r->bd + RDLN_DRPZ) {
+		/* keep the resident part of mappings small */
+		rdln_drop(r);
+	}
+	*ln = r->buf + r->bi;
+	r->bs = eo;
+	eo -= r->bi;
+	r->bi = r->bs;
+	return eo;
+}
+
+int
+rdln_rewind(rdln_t r)
+{
+	if (r->mapp) {
+		/* just start over, dropped pages come back by themselves */
+		r->bd = 0U;
+	} else if (r->of0 < 0) {
+		return -1;
+	} else if (UNLIKELY(lseek(r->fd, r->of0, SEEK_SET) < 0)) {
+		return -1;
+	} else {
+		r->be = 0U;
+		r->eofp = 0U;
+	}
+	r->bi = r->bs = 0U;
+	return 0;
+}
+
+int
+rdln_stablep(rdln_t r)
+{
+	return r->mapp;
+}
+
+size_t
+rdln_peek(const char **p, rdln_t r)
+{
+	*p = r->buf + r->bi;
+	return r->be - r->bi;
+}
+
+/* rdln.c ends here */
@@ -0,0 +1,80 @@
+/*** rdln.h -- block-buffered line reader
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_rdln_h_
+#define INCLUDED_rdln_h_
+
+#include <unistd.h>
+
+typedef struct rdln_s *rdln_t;
+
+/**
+ * Set up a line reader on descriptor FD.
+ * Regular files are mapped into memory as a whole, anything else is
+ * read(2) in large blocks.  The descriptor is not closed by the reader. */
+extern rdln_t rdln_open(int fd);
+
+/**
+ * Release all resources associated with reader R. */
+extern void rdln_close(rdln_t r);
+
+/**
+ * Put the next line of R into *LN and return its length, including
+ * the trailing newline if any.  Like getline(3) return -1 upon end of
+ * input or error.
+ * The line is not copied unless it straddles two blocks, so *LN is only
+ * valid until the next call, or for stable readers (see below) until
+ * the reader is closed. */
+extern ssize_t rdln_getln(const char **ln, rdln_t r);
+
+/**
+ * Reposition R to where it started reading.
+ * Return -1 if R's descriptor isn't seekable, leaving R untouched.
+ * Stable readers (see below) can always be rewound.
+ * Lines obtained before are invalidated unless R is stable. */
+extern int rdln_rewind(rdln_t r);
+
+/**
+ * Return non-0 if lines of R stay valid until R is closed. */
+extern int rdln_stablep(rdln_t r);
+
+/**
+ * Put the data R has buffered past the last line into *P and return
+ * its size, without consuming it.  The data is valid like lines are,
+ * and it may end in an incomplete line. */
+extern size_t rdln_peek(const char **p, rdln_t r);
+
+#endif	/* INCLUDED_rdln_h_ */
@@ -0,0 +1,253 @@
+/*** tok.c -- field tokeniser for tab separated lines
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "tok.h"
+#include "nifty.h"
+
+#if defined __GNUC__ && !defined __TINYC__ &&			\
+	(defined __x86_64__ || defined __i386__)
+# define WITH_X86_KERNELS
+# include <immintrin.h>
+#endif	/* __GNUC__ && x86 */
+
+
+/* scalar fallbacks */
+static size_t
+toklng_scal(const char *ln, size_t lz)
+{
+	const char *const ep = memchr(ln, '\n', lz) ?: ln + lz;
+	size_t ncol = 1U;
+
+	for (const char *lp = ln, *np;
+	     (np = memchr(lp, '\t', ep - lp)); lp = np + 1U) {
+		ncol++;
+	}
+	return ncol;
+}
+
+static size_t
+tokln1_scal(size_t *restrict c, size_t nc, const char *ln, size_t lz)
+{
+	const char *const ep = memchr(ln, '\n', lz) ?: ln + lz;
+	size_t j = 0U;
+
+	c[j++] = 0U;
+	for (const char *lp = ln, *np;
+	     j < nc && lp < ep && (np = memchr(lp, '\t', ep - lp));
+	     lp = np + 1U, j++) {
+		c[j] = np + 1U - ln;
+	}
+	c[j] = ep - ln + 1U;
+	return j;
+}
+
+
+#if defined WITH_X86_KERNELS
+/* The kernels below classify 64 bytes per round, yielding one bitmask
+ * for tabs and one for newlines.  Tab bits past the first newline are
+ * masked out, the rest is handed out bit by bit.  The tail (less than
+ * 64 bytes) is done byte-wise. */
+#define DEFTOKLNG(name, attr, mask64)					\
+static attr size_t							\
+name(const char *ln, size_t lz)						\
+{									\
+	size_t ncol = 1U;						\
+	size_t i = 0U;							\
+									\
+	for (; i + 64U <= lz; i += 64U) {				\
+		uint64_t t = mask64(ln + i, '\t');			\
+		uint64_t n = mask64(ln + i, '\n');			\
+									\
+		if (UNLIKELY(n)) {					\
+			t &= (n & -n) - 1U;				\
+			return ncol + __builtin_popcountll(t);		\
+		}							\
+		ncol += __builtin_popcountll(t);			\
+	}								\
+	for (; i < lz && ln[i] != '\n'; i++) {				\
+		ncol += ln[i] == '\t';					\
+	}								\
+	return ncol;							\
+}
+
+#define DEFTOKLN1(name, attr, mask64)					\
+static attr size_t							\
+name(size_t *restrict c, size_t nc, const char *ln, size_t lz)		\
+{									\
+	size_t j = 0U;							\
+	size_t i = 0U;							\
+									\
+	c[j++] = 0U;							\
+	if (UNLIKELY(j >= nc)) {					\
+		goto eol;						\
+	}								\
+	for (; i + 64U <= lz; i += 64U) {				\
+		uint64_t t = mask64(ln + i, '\t');			\
+		uint64_t n = mask64(ln + i, '\n');			\
+									\
+		if (UNLIKELY(n)) {					\
+			/* only consider tabs before the newline */	\
+			t &= (n & -n) - 1U;				\
+			lz = i + __builtin_ctzll(n);			\
+		}							\
+		for (; t && j < nc; t &= t - 1U) {			\
+			c[j++] = i + __builtin_ctzll(t) + 1U;		\
+		}							\
+		if (UNLIKELY(j >= nc)) {				\
+			goto eol;					\
+		} else if (UNLIKELY(n)) {				\
+			goto fin;					\
+		}							\
+	}								\
+	for (; i < lz; i++) {						\
+		if (ln[i] == '\t') {					\
+			c[j++] = i + 1U;				\
+			if (UNLIKELY(j >= nc)) {			\
+				goto eol;				\
+			}						\
+		} else if (ln[i] == '\n') {				\
+			lz = i;						\
+			break;						\
+		}							\
+	}								\
+	goto fin;							\
+eol:									\
+	/* field limit reached, last field extends to end of line */	\
+	with (const char *ep = memchr(ln + i, '\n', lz - i)) {		\
+		lz = ep ? (size_t)(ep - ln) : lz;			\
+	}								\
+fin:									\
+	c[j] = lz + 1U;							\
+	return j;							\
+}
+
+static inline __attribute__((target("sse2"))) uint64_t
+mask64_sse2(const char *p, char x)
+{
+	const __m128i v = _mm_set1_epi8(x);
+	const __m128i *q = (const __m128i*)p;
+	uint64_t m0 = (uint16_t)_mm_movemask_epi8(
+		_mm_cmpeq_epi8(_mm_loadu_si128(q + 0U), v));
+	uint64_t m1 = (uint16_t)_mm_movemask_epi8(
+		_mm_cmpeq_epi8(_mm_loadu_si128(q + 1U), v));
+	uint64_t m2 = (uint16_t)_mm_movemask_epi8(
+		_mm_cmpeq_epi8(_mm_loadu_si128(q + 2U), v));
+	uint64_t m3 = (uint16_t)_mm_movemask_epi8(
+		_mm_cmpeq_epi8(_mm_loadu_si128(q + 3U), v));
+	return m0 ^ m1 << 16U ^ m2 << 32U ^ m3 << 48U;
+}
+
+static inline __attribute__((target("avx2"))) uint64_t
+mask64_avx2(const char *p, char x)
+{
+	const __m256i v = _mm256_set1_epi8(x);
+	const __m256i *q = (const __m256i*)p;
+	uint64_t m0 = (uint32_t)_mm256_movemask_epi8(
+		_mm256_cmpeq_epi8(_mm256_loadu_si256(q + 0U), v));
+	uint64_t m1 = (uint32_t)_mm256_movemask_epi8(
+		_mm256_cmpeq_epi8(_mm256_loadu_si256(q + 1U), v));
+	return m0 ^ m1 << 32U;
+}
+
+DEFTOKLNG(toklng_sse2, __attribute__((target("sse2"))), mask64_sse2)
+DEFTOKLN1(tokln1_sse2, __attribute__((target("sse2"))), mask64_sse2)
+DEFTOKLNG(toklng_avx2, __attribute__((target("avx2"))), mask64_avx2)
+DEFTOKLN1(tokln1_avx2, __attribute__((target("avx2"))), mask64_avx2)
+#endif	/* WITH_X86_KERNELS */
+
+
+/* dispatch, resolved upon first use */
+static size_t toklng_init(const char*, size_t);
+static size_t tokln1_init(size_t *restrict, size_t, const char*, size_t);
+
+static size_t(*_toklng)(const char*, size_t) = toklng_init;
+static size_t(*_tokln1)(size_t *restrict, size_t, const char*, size_t) =
+	tokln1_init;
+
+static void
+tok_init(void)
+{
+#if defined WITH_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		_toklng = toklng_avx2;
+		_tokln1 = tokln1_avx2;
+		return;
+	} else if (__builtin_cpu_supports("sse2")) {
+		_toklng = toklng_sse2;
+		_tokln1 = tokln1_sse2;
+		return;
+	}
+#endif	/* WITH_X86_KERNELS */
+	_toklng = toklng_scal;
+	_tokln1 = tokln1_scal;
+	return;
+}
+
+static size_t
+toklng_init(const char *ln, size_t lz)
+{
+	tok_init();
+	return _toklng(ln, lz);
+}
+
+static size_t
+tokln1_init(size_t *restrict c, size_t nc, const char *ln, size_t lz)
+{
+	tok_init();
+	return _tokln1(c, nc, ln, lz);
+}
+
+
+size_t
+toklng(const char *ln, size_t lz)
+{
+	return _toklng(ln, lz);
+}
+
+size_t
+tokln1(size_t *restrict c, size_t nc, const char *ln, size_t lz)
+{
+	return _tokln1(c, nc, ln, lz);
+}
+
+/* tok.c ends here */
@@ -0,0 +1,477 @@
+/*** typ.c -- typed values
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "typ.h"
+#include "nifty.h"
+
+#if defined __BYTE_ORDER__ && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+# define TYP_SWAR	1
+#endif	/* little endian */
+
+/* longest number we hand to strtod(3) */
+#define TYP_SLOWZ	(256U)
+
+/* powers of ten exactly representable as double, spelt as integers
+ * to keep float constants suffix-free, those past 2^64 are exact
+ * products of exact values */
+#define P10_19	(10000000000000000000ULL)
+static const double p10[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL, P10_19,
+	(double)P10_19 * 10U, (double)P10_19 * 100U, (double)P10_19 * 1000U,
+};
+
+
+#if defined TYP_SWAR
+/* 8 digits at a time, little endian only */
+static inline int
+dig8p(uint64_t w)
+{
+/* check if all bytes of W are ASCII digits */
+	const uint64_t hi = w & 0xF0F0F0F0F0F0F0F0ULL;
+	const uint64_t lo = (w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL;
+	return (hi | lo >> 4U) == 0x3333333333333333ULL;
+}
+
+static inline uint64_t
+dig8(uint64_t w)
+{
+/* the value of the 8 ASCII digits in W, first digit in the lowest byte */
+	const uint64_t m = 0x000000FF000000FFULL;
+
+	w -= 0x3030303030303030ULL;
+	w = w * 10U + (w >> 8U);
+	return ((w & m) * 0x000F424000000064ULL +
+		((w >> 16U) & m) * 0x0000271000000001ULL) >> 32U;
+}
+#endif	/* TYP_SWAR */
+
+static inline size_t
+dgts(uint64_t *restrict m, const char *s, size_t z)
+{
+/* accumulate leading digits of S of size Z into *M, return their number */
+	uint64_t x = *m;
+	size_t i = 0U;
+
+#if defined TYP_SWAR
+	for (uint64_t w; i + 8U <= z; i += 8U) {
+		memcpy(&w, s + i, sizeof(w));
+		if (!dig8p(w)) {
+			break;
+		}
+		x = x * 100000000U + dig8(w);
+	}
+#endif	/* TYP_SWAR */
+	for (unsigned int d; i < z && (d = s[i] ^ '0') < 10U; i++) {
+		x = x * 10U + d;
+	}
+	*m = x;
+	return i;
+}
+
+static int32_t
+dfc(int y, unsigned int m, unsigned int d)
+{
+/* days since 1970-01-01 of Y-M-D, proleptic Gregorian */
+	y -= m <= 2U;
+	const int era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned int yoe = (unsigned int)(y - era * 400);
+	const unsigned int doy = (153U * (m > 2U ? m - 3U : m + 9U) + 2U) / 5U +
+		d - 1U;
+	const unsigned int doe = yoe * 365U + yoe / 4U - yoe / 100U + doy;
+	return era * 146097 + (int)doe - 719468;
+}
+
+static void
+cfd(int *restrict y, unsigned int *restrict m, unsigned int *restrict d,
+    int32_t t)
+{
+/* inverse of dfc() */
+	const int32_t z = t + 719468;
+	const int era = (z >= 0 ? z : z - 146096) / 146097;
+	const unsigned int doe = (unsigned int)(z - era * 146097);
+	const unsigned int yoe =
+		(doe - doe / 1460U + doe / 36524U - doe / 146096U) / 365U;
+	const unsigned int doy = doe - (365U * yoe + yoe / 4U - yoe / 100U);
+	const unsigned int mp = (5U * doy + 2U) / 153U;
+
+	*d = doy - (153U * mp + 2U) / 5U + 1U;
+	*m = mp < 10U ? mp + 3U : mp - 9U;
+	*y = (int)yoe + era * 400 + (*m <= 2U);
+	return;
+}
+
+static inline int
+skpd(const char **p, const char *e)
+{
+/* skip digits at *P before E, return non-0 if there were any */
+	const char *const p0 = *p;
+
+	for (; *p < e && (unsigned char)(**p ^ '0') < 10U; (*p)++);
+	return *p > p0;
+}
+
+static int
+dbl_slow(double *restrict x, const char *s, size_t z)
+{
+/* like the fast path only decimals [-+]D*[.D*][(e|E)[-+]D+] are taken,
+ * strtod(3) merely rounds them, its nan, inf, hex floats and leading
+ * whitespace don't count as doubles */
+	const char *p = s;
+	const char *const e = s + z;
+	char buf[TYP_SLOWZ];
+	char *on;
+	int dp;
+
+	if (UNLIKELY(!z || z >= sizeof(buf))) {
+		return -1;
+	}
+	if (p < e && (*p == '-' || *p == '+')) {
+		p++;
+	}
+	dp = skpd(&p, e);
+	if (p < e && *p == '.') {
+		p++;
+		dp |= skpd(&p, e);
+	}
+	if (!dp) {
+		return -1;
+	} else if (p < e && (*p == 'e' || *p == 'E')) {
+		if (++p < e && (*p == '-' || *p == '+')) {
+			p++;
+		}
+		if (!skpd(&p, e)) {
+			return -1;
+		}
+	}
+	if (p < e) {
+		return -1;
+	}
+	memcpy(buf, s, z);
+	buf[z] = '\0';
+	*x = strtod(buf, &on);
+	/* overflows would come back as inf */
+	return *on || isinf(*x) ? -1 : 0;
+}
+
+static size_t
+fmtu(char *restrict buf, uint64_t m, size_t w)
+{
+/* print M in decimal, zero-padded to at least W digits */
+	char tmp[24U];
+	size_t n = 0U;
+
+	do {
+		tmp[n++] = (char)('0' + m % 10U);
+	} while ((m /= 10U) || n < w);
+	for (size_t i = 0U; i < n; i++) {
+		buf[i] = tmp[n - i - 1U];
+	}
+	return n;
+}
+
+static size_t
+fmtd(char *restrict buf, double x)
+{
+/* print X as shortest decimal M / 10^K that reads back as X, provided
+ * M has at most 15 digits and 1e-4 <= |X| < 1e15 where %.15g would
+ * print the same, return 0 if there's no such decimal */
+	const double ax = fabs(x);
+	size_t n = 0U;
+
+	if (!(ax >= 1 / p10[4U] && ax < p10[15U])) {
+		return 0U;
+	}
+	for (size_t k = 0U; k <= 8U; k++) {
+		const uint64_t m = (uint64_t)(ax * p10[k] + .5f);
+
+		if (m >= 1000000000000000ULL) {
+			break;
+		} else if ((double)m / p10[k] != ax) {
+			continue;
+		}
+		if (x < 0) {
+			buf[n++] = '-';
+		}
+		if (!k) {
+			return n + fmtu(buf + n, m, 1U);
+		}
+		with (const uint64_t q = (uint64_t)p10[k]) {
+			n += fmtu(buf + n, m / q, 1U);
+			buf[n++] = '.';
+			n += fmtu(buf + n, m % q, k);
+		}
+		return n;
+	}
+	return 0U;
+}
+
+
+typ_t
+typ_of_name(const char *s, size_t z)
+{
+	static const struct {
+		const char *nm;
+		typ_t t;
+	} nms[] = {
+		{"str", TYP_STR}, {"string", TYP_STR},
+		{"int", TYP_INT}, {"integer", TYP_INT},
+		{"float", TYP_DBL}, {"double", TYP_DBL},
+		{"date", TYP_DATE},
+	};
+
+	for (size_t i = 0U; i < countof(nms); i++) {
+		if (strlen(nms[i].nm) == z && !memcmp(nms[i].nm, s, z)) {
+			return nms[i].t;
+		}
+	}
+	return TYP_NIL;
+}
+
+int
+typ_int(int64_t *restrict x, const char *s, size_t z)
+{
+	const char *const e = s + z;
+	uint64_t m = 0U;
+	int neg = 0;
+	size_t n;
+
+	if (s < e && (*s == '-' || *s == '+')) {
+		neg = *s++ == '-';
+	}
+	/* leading zeroes don't count towards the 19 digits */
+	for (; s + 1U < e && *s == '0'; s++);
+	if (UNLIKELY(s >= e)) {
+		goto na;
+	} else if ((n = dgts(&m, s, e - s)) < (size_t)(e - s) || n > 19U) {
+		goto na;
+	} else if (UNLIKELY(m > (uint64_t)INT64_MAX)) {
+		goto na;
+	}
+	*x = neg ? -(int64_t)m : (int64_t)m;
+	return 0;
+na:
+	*x = TYP_NA_INT;
+	return -1;
+}
+
+int
+typ_dbl(double *restrict x, const char *s, size_t z)
+{
+/* the fast path is exact for up to 19 digits, an integral mantissa of
+ * at most 2^53 and decimal exponents within [-22, 22], beyond that
+ * strtod(3) rounds, see dbl_slow() */
+	const char *p = s;
+	const char *const e = s + z;
+	uint64_t m = 0U;
+	size_t ni, nf = 0U;
+	long int x10 = 0;
+	const char *d0;
+	int neg = 0;
+	int dp;
+
+	if (p < e && (*p == '-' || *p == '+')) {
+		neg = *p++ == '-';
+	}
+	for (d0 = p; p < e && *p == '0'; p++);
+	ni = dgts(&m, p, e - p);
+	p += ni;
+	dp = p > d0;
+	if (p < e && *p == '.') {
+		const char *q = ++p;
+
+		if (!m) {
+			/* leading zeroes of the fraction are free */
+			for (; p < e && *p == '0'; p++);
+			x10 -= p - q;
+		}
+		nf = dgts(&m, p, e - p);
+		p += nf;
+		x10 -= nf;
+		dp |= p > q;
+	}
+	if (UNLIKELY(!dp)) {
+		/* no digits at all */
+		goto slow;
+	} else if (p < e && (*p == 'e' || *p == 'E')) {
+		uint64_t ux = 0U;
+		int xneg = 0;
+		size_t nx;
+
+		if (++p < e && (*p == '-' || *p == '+')) {
+			xneg = *p++ == '-';
+		}
+		if (!(nx = dgts(&ux, p, e - p)) || nx > 3U) {
+			goto slow;
+		}
+		p += nx;
+		x10 += xneg ? -(long int)ux : (long int)ux;
+	}
+	if (UNLIKELY(p < e)) {
+		goto slow;
+	} else if (UNLIKELY(ni + nf > 19U || m > (1ULL << 53U))) {
+		goto slow;
+	} else if (UNLIKELY(x10 < -22 || x10 > 22)) {
+		goto slow;
+	}
+	*x = x10 < 0 ? (double)m / p10[-x10] : (double)m * p10[x10];
+	*x = neg ? -*x : *x;
+	return 0;
+slow:
+	if (dbl_slow(x, s, z) < 0) {
+		*x = NAN;
+		return -1;
+	}
+	return 0;
+}
+
+int
+typ_date(int32_t *restrict x, const char *s, size_t z)
+{
+	static const unsigned char mdays[] = {
+		31U, 29U, 31U, 30U, 31U, 30U, 31U, 31U, 30U, 31U, 30U, 31U,
+	};
+	uint64_t y = 0U, m = 0U, d = 0U;
+
+	if (z != 10U || s[4U] != '-' || s[7U] != '-') {
+		goto na;
+	} else if (dgts(&y, s, 4U) < 4U ||
+		   dgts(&m, s + 5U, 2U) < 2U ||
+		   dgts(&d, s + 8U, 2U) < 2U) {
+		goto na;
+	} else if (m - 1U >= 12U || d - 1U >= mdays[m - 1U]) {
+		goto na;
+	} else if (m == 2U && d == 29U &&
+		   (y % 4U || (!(y % 100U) && y % 400U))) {
+		goto na;
+	}
+	*x = dfc((int)y, (unsigned int)m, (unsigned int)d);
+	return 0;
+na:
+	*x = TYP_NA_DATE;
+	return -1;
+}
+
+int
+typ_parse(typv_t *restrict v, typ_t t, const char *s, size_t z)
+{
+	switch (t) {
+	case TYP_INT:
+		return typ_int(&v->i, s, z);
+	case TYP_DBL:
+		return typ_dbl(&v->d, s, z);
+	case TYP_DATE:
+		return typ_date(&v->t, s, z);
+	default:
+		break;
+	}
+	return -1;
+}
+
+size_t
+typ_fmt(char *restrict buf, typ_t t, typv_t v)
+{
+	unsigned int m, d;
+	int y;
+
+	switch (t) {
+	case TYP_INT:
+		if (v.i == TYP_NA_INT) {
+			break;
+		}
+		if (v.i < 0) {
+			*buf = '-';
+			return 1U + fmtu(buf + 1U, -(uint64_t)v.i, 1U);
+		}
+		return fmtu(buf, v.i, 1U);
+	case TYP_DBL:
+		if (isnan(v.d)) {
+			break;
+		}
+		with (size_t n = fmtd(buf, v.d)) {
+			if (n) {
+				return n;
+			}
+		}
+		/* shortest of the two that reads back the same */
+		with (int n = snprintf(buf, TYP_FMTZ, "%.15g", v.d)) {
+			if (strtod(buf, NULL) == v.d) {
+				return n;
+			}
+		}
+		return snprintf(buf, TYP_FMTZ, "%.17g", v.d);
+	case TYP_DATE:
+		if (v.t == TYP_NA_DATE) {
+			break;
+		}
+		cfd(&y, &m, &d, v.t);
+		return snprintf(buf, TYP_FMTZ, "%04d-%02u-%02u", y, m, d);
+	default:
+		break;
+	}
+	return 0U;
+}
+
+typ_t
+typ_guess(const char *s, size_t z)
+{
+	typv_t v;
+
+	if (!z) {
+		return TYP_NIL;
+	} else if (typ_int(&v.i, s, z) >= 0) {
+		return TYP_INT;
+	} else if (typ_date(&v.t, s, z) >= 0) {
+		return TYP_DATE;
+	} else if (typ_dbl(&v.d, s, z) >= 0) {
+		return TYP_DBL;
+	}
+	return TYP_STR;
+}
+
+/* typ.c ends here */
@@ -0,0 +1,115 @@
+/*** typ.h -- typed values
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if !defined INCLUDED_typ_h_
+#define INCLUDED_typ_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Types are ordered by generality, see typ_join(). */
+typedef enum {
+	/* nothing seen yet, for inference */
+	TYP_NIL,
+	TYP_INT,
+	TYP_DBL,
+	TYP_DATE,
+	TYP_STR,
+} typ_t;
+
+typedef union {
+	int64_t i;
+	double d;
+	/* days since 1970-01-01 */
+	int32_t t;
+} typv_t;
+
+/* missing values, for doubles it's NaN */
+#define TYP_NA_INT	INT64_MIN
+#define TYP_NA_DATE	INT32_MIN
+
+/**
+ * Return the type called S (str, int, float or date), or TYP_NIL. */
+extern typ_t typ_of_name(const char *s, size_t z);
+
+/**
+ * Parse S of size Z as integer into *X.
+ * Return -1 if S isn't one, setting *X to TYP_NA_INT. */
+extern int typ_int(int64_t *restrict x, const char *s, size_t z);
+
+/**
+ * Parse S of size Z as floating point number into *X.
+ * Return -1 if S isn't one, setting *X to NaN. */
+extern int typ_dbl(double *restrict x, const char *s, size_t z);
+
+/**
+ * Parse S of size Z, an ISO 8601 date YYYY-MM-DD, into *X.
+ * Return -1 if S isn't one, setting *X to TYP_NA_DATE. */
+extern int typ_date(int32_t *restrict x, const char *s, size_t z);
+
+/**
+ * Parse S of size Z as type T into *V, see above. */
+extern int typ_parse(typv_t *restrict v, typ_t t, const char *s, size_t z);
+
+/**
+ * Format V of type T into BUF, which must hold TYP_FMTZ bytes.
+ * Return the number of bytes written, 0 for missing values. */
+extern size_t typ_fmt(char *restrict buf, typ_t t, typv_t v);
+
+#define TYP_FMTZ	(32U)
+
+/**
+ * Return the narrowest type S of size Z parses as.
+ * Empty strings are TYP_NIL. */
+extern typ_t typ_guess(const char *s, size_t z);
+
+
+/**
+ * Return the narrowest type that holds values of types A and B. */
+static inline typ_t
+typ_join(typ_t a, typ_t b)
+{
+	if (a == b || b == TYP_NIL) {
+		return a;
+	} else if (a == TYP_NIL) {
+		return b;
+	} else if (a <= TYP_DBL && b <= TYP_DBL) {
+		return TYP_DBL;
+	}
+	return TYP_STR;
+}
+
+#endif	/* INCLUDED_typ_h_ */
@@ -0,0 +1,256 @@
+/*** bench_cell.c -- measure dtcast's cell storage
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "arena.h"
+
+/* The bench mimics dtcast's cell storage for wide casts, NCC cast
+ * columns with NCEL cells per LHS group scattered across them.
+ * The col path is what dtcast used to do, a realloc'd value buffer
+ * and offsets array per cast column, cleared per group, the arena path
+ * is what dtcast does now, (column, value) cells in a bump arena per
+ * group that are gathered by column before printing.
+ * Each path runs in its own child so max RSS can be compared. */
+struct cel_s {
+	size_t j;
+	size_t o;
+	size_t z;
+};
+
+static size_t ncc = 4096U;
+static size_t ncel = 512U;
+static size_t ngrp;
+
+static char out[1U << 20U];
+static size_t nout;
+
+static uint64_t
+now(void)
+{
+/* in nanoseconds */
+	struct timespec tsp;
+	clock_gettime(CLOCK_MONOTONIC, &tsp);
+	return tsp.tv_sec * 1000000000ULL + tsp.tv_nsec;
+}
+
+static inline size_t
+rndj(uint64_t *x)
+{
+	*x = *x * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (*x >> 33U) % ncc;
+}
+
+static inline void
+emit(const char *s, size_t z)
+{
+	if (nout + z + 1U >= sizeof(out)) {
+		nout = 0U;
+	}
+	memcpy(out + nout, s, z);
+	nout += z;
+	out[nout++] = '\t';
+}
+
+static uint64_t
+run_col(void)
+{
+	size_t *nccv = calloc(ncc, sizeof(*nccv));
+	size_t *zccv = calloc(ncc, sizeof(*zccv));
+	char **ccv = calloc(ncc, sizeof(*ccv));
+	size_t *zccvo = calloc(ncc, sizeof(*zccvo));
+	size_t **ccvo = calloc(ncc, sizeof(*ccvo));
+	uint64_t x = 1U, sum = 0U;
+
+	for (size_t j = 0U; j < ncc; j++) {
+		ccvo[j] = calloc(zccvo[j] = 8U, sizeof(*ccvo[j]));
+	}
+	for (size_t g = 0U; g < ngrp; g++) {
+		memset(nccv, 0, ncc * sizeof(*nccv));
+		for (size_t j = 0U; j < ncc; j++) {
+			ccvo[j][0U] = ccvo[j][1U] = 0U;
+		}
+		for (size_t i = 0U; i < ncel; i++) {
+			const size_t j = rndj(&x);
+			char v[32U];
+			const size_t z = snprintf(v, sizeof(v), "%zu.25", i);
+			size_t nj = ccvo[j][nccv[j]];
+
+			if (nj + z >= zccv[j]) {
+				while ((zccv[j] = (zccv[j] * 2U) ?: 64U) <
+				       nj + z);
+				ccv[j] = realloc(ccv[j], zccv[j]);
+			}
+			if (++nccv[j] >= zccvo[j]) {
+				zccvo[j] *= 2U;
+				ccvo[j] = realloc(ccvo[j],
+						  zccvo[j] * sizeof(*ccvo[j]));
+			}
+			ccvo[j][nccv[j]] = nj + z;
+			memcpy(ccv[j] + nj, v, z);
+		}
+		for (size_t j = 0U; j < ncc; j++) {
+			for (size_t m = 0U; m < nccv[j]; m++) {
+				emit(ccv[j] + ccvo[j][m],
+				     ccvo[j][m + 1U] - ccvo[j][m]);
+			}
+		}
+		sum += nout;
+	}
+	for (size_t j = 0U; j < ncc; j++) {
+		free(ccv[j]);
+		free(ccvo[j]);
+	}
+	free(nccv);
+	free(zccv);
+	free(ccv);
+	free(zccvo);
+	free(ccvo);
+	return sum;
+}
+
+static uint64_t
+run_arena(void)
+{
+	struct arena_s cel = {0U};
+	struct arena_s val = {0U};
+	struct cel_s *gc = malloc(ncel * sizeof(*gc));
+	size_t *go = malloc((ncc + 2U) * sizeof(*go));
+	uint64_t x = 1U, sum = 0U;
+
+	for (size_t g = 0U; g < ngrp; g++) {
+		const struct cel_s *c;
+
+		arena_reset(&cel);
+		arena_reset(&val);
+		for (size_t i = 0U; i < ncel; i++) {
+			const size_t j = rndj(&x);
+			char v[32U];
+			const size_t z = snprintf(v, sizeof(v), "%zu.25", i);
+			const size_t o = arena_add(&val, v, z);
+			const size_t k = arena_alloc(&cel, sizeof(*c));
+
+			*(struct cel_s*)arena_ptr(&cel, k) =
+				(struct cel_s){j, o, z};
+		}
+		/* gather */
+		c = arena_ptr(&cel, 0U);
+		memset(go, 0, (ncc + 2U) * sizeof(*go));
+		for (size_t i = 0U; i < ncel; i++) {
+			go[c[i].j + 2U]++;
+		}
+		for (size_t j = 2U; j < ncc + 2U; j++) {
+			go[j] += go[j - 1U];
+		}
+		for (size_t i = 0U; i < ncel; i++) {
+			gc[go[c[i].j + 1U]++] = c[i];
+		}
+		for (size_t j = 0U; j < ncc; j++) {
+			for (size_t m = go[j]; m < go[j + 1U]; m++) {
+				emit(arena_ptr(&val, gc[m].o), gc[m].z);
+			}
+		}
+		sum += nout;
+	}
+	arena_fini(&cel);
+	arena_fini(&val);
+	free(gc);
+	free(go);
+	return sum;
+}
+
+static int
+bench(const char *name, uint64_t(*run)(void))
+{
+	struct rusage ru;
+	int st;
+	pid_t p;
+
+	fflush(stdout);
+	if ((p = fork()) < 0) {
+		return -1;
+	} else if (!p) {
+		const uint64_t t0 = now();
+		const uint64_t r = run();
+		const uint64_t t1 = now();
+
+		printf("%s\t%" PRIu64 "ms\t%" PRIu64 "ns/cell\t%" PRIu64 "\n",
+		       name, (t1 - t0) / 1000000U,
+		       (t1 - t0) / (ngrp * ncel), r);
+		fflush(stdout);
+		_exit(0);
+	} else if (wait4(p, &st, 0, &ru) < 0 || st) {
+		return -1;
+	}
+	printf("%s\t%ldkB max rss\n", name, ru.ru_maxrss);
+	return 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	const size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 20000000U;
+
+	if (argc > 2) {
+		ncc = strtoul(argv[2], NULL, 0);
+	}
+	if (argc > 3) {
+		ncel = strtoul(argv[3], NULL, 0);
+	}
+	ngrp = n / ncel ?: 1U;
+
+	printf("cells\t%zu\tcolumns\t%zu\tper group\t%zu\n",
+	       ngrp * ncel, ncc, ncel);
+	if (bench("col", run_col) < 0 || bench("arena", run_arena) < 0) {
+		return 1;
+	}
+	return 0;
+}
+
+/* bench_cell.c ends here */
@@ -0,0 +1,207 @@
+/*** bench_hash.c -- compare key hash throughput
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "rdln.h"
+#include "tok.h"
+#include "hash.h"
+
+/* Keys are the fields of the file given on the command line, or,
+ * without one, what dtcast typically sees: dates, tickers and short
+ * field names, cycled like in a molten file. */
+static char *keys;
+static size_t *ko;
+static size_t nk;
+
+static uint64_t
+now(void)
+{
+/* in nanoseconds */
+	struct timespec tsp;
+	clock_gettime(CLOCK_MONOTONIC, &tsp);
+	return tsp.tv_sec * 1000000000ULL + tsp.tv_nsec;
+}
+
+static int
+addk(const char *k, size_t kz)
+{
+	static size_t zk, zko, nb;
+
+	if (nb + kz > zk) {
+		zk = (zk ? zk * 2U : 4096U) + kz;
+		if ((keys = realloc(keys, zk)) == NULL) {
+			return -1;
+		}
+	}
+	if (nk + 2U > zko) {
+		zko = zko ? zko * 2U : 1024U;
+		if ((ko = realloc(ko, zko * sizeof(*ko))) == NULL) {
+			return -1;
+		}
+	}
+	memcpy(keys + nb, k, kz);
+	ko[nk++] = nb;
+	ko[nk] = nb += kz;
+	return 0;
+}
+
+static int
+mkkeys(size_t n)
+{
+	static const char *const typ[] = {
+		"open", "high", "low", "close", "volume", "vwap", "bid", "ask",
+	};
+	static const char *const sym[] = {
+		"AX", "BZX", "EURUSD", "ES", "VOD.L", "AAPL", "BRK.B", "X",
+	};
+
+	for (size_t i = 0U; i < n; i++) {
+		char d[16U];
+		size_t z;
+
+		z = snprintf(d, sizeof(d), "20%02zu-%02zu-%02zu",
+			     i / 8192U % 100U, i / 256U % 12U + 1U,
+			     i / 8U % 28U + 1U);
+		if (addk(d, z) < 0 ||
+		    addk(sym[i / 64U % 8U], strlen(sym[i / 64U % 8U])) < 0 ||
+		    addk(typ[i % 8U], strlen(typ[i % 8U])) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+rdkeys(const char *fn)
+{
+	int fd;
+	rdln_t rd;
+	size_t of[64U + 1U];
+	const char *ln;
+	int rc = 0;
+
+	if ((fd = open(fn, O_RDONLY)) < 0) {
+		return -1;
+	} else if ((rd = rdln_open(fd)) == NULL) {
+		close(fd);
+		return -1;
+	}
+	for (ssize_t nrd; (nrd = rdln_getln(&ln, rd)) > 0;) {
+		const size_t nf = tokln1(of, 64U, ln, nrd);
+
+		for (size_t i = 0U; i < nf; i++) {
+			if ((rc = addk(ln + of[i], of[i + 1U] - of[i] - 1U))) {
+				goto out;
+			}
+		}
+	}
+out:
+	rdln_close(rd);
+	close(fd);
+	return rc;
+}
+
+#define DEFBENCH(name, fun)						\
+static uint64_t								\
+name(size_t nrounds, uint64_t *restrict chk)				\
+{									\
+	const uint64_t t0 = now();					\
+	uint64_t x = 0U;						\
+									\
+	for (size_t r = 0U; r < nrounds; r++) {				\
+		for (size_t i = 0U; i < nk; i++) {			\
+			x += fun(keys + ko[i], ko[i + 1U] - ko[i], r);	\
+		}							\
+	}								\
+	*chk = x;							\
+	return now() - t0;						\
+}
+
+DEFBENCH(bench_murmur, MurmurHash64A)
+DEFBENCH(bench_wyhash, wyhash64)
+
+
+int
+main(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		uint64_t(*bench)(size_t, uint64_t*);
+	} b[] = {
+		{"murmur", bench_murmur},
+		{"wyhash", bench_wyhash},
+	};
+	size_t nrounds = 16U;
+
+	if (argc > 1 && rdkeys(argv[1]) < 0) {
+		perror("Error: cannot read keys");
+		return 1;
+	} else if (argc <= 1 && mkkeys(1000000U) < 0) {
+		return 1;
+	} else if (!nk) {
+		return 0;
+	}
+	if (nk * nrounds < 16000000U) {
+		nrounds = 16000000U / nk;
+	}
+
+	printf("keys\t%zu\t%zu bytes/key\n", nk, ko[nk] / nk);
+	for (size_t i = 0U; i < sizeof(b) / sizeof(*b); i++) {
+		uint64_t chk;
+		uint64_t t;
+
+		/* warm up */
+		b[i].bench(1U, &chk);
+		t = b[i].bench(nrounds, &chk);
+		printf("%s\t%" PRIu64 "ms\t%" PRIu64 "ps/key\t%016" PRIx64 "\n",
+		       b[i].name, t / 1000000U, t * 1000U / (nk * nrounds), chk);
+	}
+	free(keys);
+	free(ko);
+	return 0;
+}
+
+/* bench_hash.c ends here */
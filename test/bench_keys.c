@@ -0,0 +1,201 @@
+/*** bench_keys.c -- measure dtcast's key hashing and verification
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "tok.h"
+#include "hash.h"
+#include "htab.h"
+#include "arena.h"
+
+/* The bench mimics dtcast '1+2~3+4', i.e. two LHS and two RHS fields.
+ * The xor path is what dtcast used to do, hash fields with their
+ * position as seed and xor the lot, the chain path is what dtcast does
+ * now, chaining hashes and memcmp'ing keys when hashes agree. */
+#define NLHS	2U
+#define NRHS	2U
+#define NCOL	(NLHS + NRHS + 1U)
+
+static char *lines;
+static size_t *lo;
+static size_t nln;
+static size_t ncc = 64U;
+
+static uint64_t
+now(void)
+{
+/* in nanoseconds */
+	struct timespec tsp;
+	clock_gettime(CLOCK_MONOTONIC, &tsp);
+	return tsp.tv_sec * 1000000000ULL + tsp.tv_nsec;
+}
+
+static void
+mklines(size_t n)
+{
+	size_t z = 0U, zz = 64U * n;
+
+	lines = malloc(zz);
+	lo = malloc((n + 1U) * sizeof(*lo));
+	for (size_t i = 0U; i < n; i++) {
+		const size_t g = i / ncc, c = i % ncc;
+		lo[i] = z;
+		z += snprintf(lines + z, zz - z,
+			      "2018-%06zu\tSYM%zu\ttype%zu\tsub%zu\t%zu.25\n",
+			      g / 4U, g % 4U, c / 8U, c % 8U, i);
+	}
+	lo[nln = n] = z;
+	return;
+}
+
+static inline uint64_t
+hash_xor(const char *ln, const size_t *of, size_t b, size_t n)
+{
+	uint64_t d = 0U;
+	for (size_t i = 0U; i < n; i++) {
+		const size_t bo = of[b + i], eo = of[b + i + 1U];
+		d ^= hash2(ln + bo, eo - bo - 1U, i);
+	}
+	return d;
+}
+
+static inline uint64_t
+hash_chn(const char *ln, const size_t *of, size_t b, size_t n)
+{
+	uint64_t d = 0U;
+	for (size_t i = 0U; i < n; i++) {
+		const size_t bo = of[b + i], eo = of[b + i + 1U];
+		d = hashc(d, ln + bo, eo - bo - 1U);
+	}
+	return d;
+}
+
+static inline int
+keyeq(const char *k, size_t kz, const char *ln, const size_t *of,
+      size_t b, size_t n)
+{
+	const size_t bo = of[b], eo = of[b + n] - 1U;
+	return eo - bo == kz && !memcmp(k, ln + bo, kz);
+}
+
+static size_t
+run(int verifyp)
+{
+	struct htab_s x = {0U};
+	struct arena_s a = {0U};
+	size_t ko[ncc + 1U];
+	char dim[256U];
+	size_t ndim = 0U;
+	uint64_t last = 0U;
+	size_t ngrp = 0U, ncel = 0U, nk = 0U;
+	size_t of[NCOL + 1U];
+
+	ko[0U] = 0U;
+	for (size_t i = 0U; i < nln; i++) {
+		const char *ln = lines + lo[i];
+		const size_t lz = lo[i + 1U] - lo[i];
+		uint64_t d, c;
+		size_t j;
+
+		tokln1(of, NCOL, ln, lz);
+		d = (verifyp ? hash_chn : hash_xor)(ln, of, 0U, NLHS);
+		if (d != last ||
+		    verifyp && !keyeq(dim, ndim, ln, of, 0U, NLHS)) {
+			ngrp++;
+			last = d;
+			ndim = of[NLHS] - 1U;
+			memcpy(dim, ln, ndim);
+		}
+		c = (verifyp ? hash_chn : hash_xor)(ln, of, NLHS, NRHS);
+		if (!verifyp) {
+			j = htab_get(&x, c);
+		} else {
+			size_t p = htab_home(&x, c);
+			while ((j = htab_next(&x, c, &p)) != HTAB_NIL &&
+			       !keyeq(arena_ptr(&a, ko[j]), ko[j + 1U] - ko[j],
+				      ln, of, NLHS, NRHS));
+		}
+		if (j == HTAB_NIL) {
+			const size_t bo = of[NLHS], eo = of[NLHS + NRHS] - 1U;
+			htab_put(&x, c, j = nk);
+			arena_add(&a, ln + bo, eo - bo);
+			ko[++nk] = a.n;
+		}
+		ncel += j;
+	}
+	htab_fini(&x);
+	arena_fini(&a);
+	return ngrp + ncel;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	const size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 4000000U;
+	uint64_t t0, t1, t2;
+	size_t r1, r2;
+
+	mklines(n);
+	/* warm up */
+	run(0);
+
+	t0 = now();
+	r1 = run(0);
+	t1 = now();
+	r2 = run(1);
+	t2 = now();
+
+	printf("lines\t%zu\n", nln);
+	printf("xor\t%" PRIu64 "ms\t%" PRIu64 "ns/line\n",
+	       (t1 - t0) / 1000000U, (t1 - t0) / nln);
+	printf("chain\t%" PRIu64 "ms\t%" PRIu64 "ns/line\n",
+	       (t2 - t1) / 1000000U, (t2 - t1) / nln);
+	printf("overhead\t%" PRId64 "%%\n",
+	       (int64_t)((t2 - t1) * 100U / (t1 - t0)) - 100);
+	free(lines);
+	free(lo);
+	return r1 != r2;
+}
+
+/* bench_keys.c ends here */
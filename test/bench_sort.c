@@ -0,0 +1,164 @@
+/*** bench_sort.c -- measure the sortedness check of dtmerge's readers
+ *
+ * Copyright (C) 2018 Sebastian Freundt
+ *
+ * Author:  Sebastian Freundt <freundt@ga-group.nl>
+ *
+ * This file is part of dtcl.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the author nor the names of any contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ***/
+#if defined HAVE_CONFIG_H
+# include "config.h"
+#endif	/* HAVE_CONFIG_H */
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "tok.h"
+#include "rdln.h"
+#include "key.h"
+
+/* The bench mimics a reader of dtmerge '1+2', i.e. lines are read off
+ * a file, tokenised and their two join columns encoded as key.
+ * The plain path is what the readers used to do, the check path
+ * additionally compares every key with the previous one, kept in the
+ * other of two key buffers. */
+#define NJC	2U
+#define NCOL	(NJC + 4U)
+#define NRUN	15U
+
+static int fd = -1;
+static size_t nln;
+
+static uint64_t
+now(void)
+{
+/* in nanoseconds */
+	struct timespec tsp;
+	clock_gettime(CLOCK_MONOTONIC, &tsp);
+	return tsp.tv_sec * 1000000000ULL + tsp.tv_nsec;
+}
+
+static int
+mklines(size_t n)
+{
+	char fn[] = "/tmp/bench_sort.XXXXXX";
+	FILE *f;
+
+	if ((fd = mkstemp(fn)) < 0 || (f = fdopen(dup(fd), "w")) == NULL) {
+		return -1;
+	}
+	unlink(fn);
+	for (size_t i = 0U; i < n; i++) {
+		fprintf(f, "2018-%06zu\tSYM%05zu\tXNGS\t%zu\t%zu.25\t%zu.50\n",
+			i / 2000U, i % 2000U, i * 100U, i, i);
+	}
+	nln = n;
+	return fclose(f);
+}
+
+static size_t
+run(int checkp)
+{
+	static const keycmp_t kc[NJC] = {KEY_LEX, KEY_LEX};
+	unsigned char key[2U][256U];
+	struct key_s k, pk = {0U};
+	size_t of[NCOL + 1U];
+	size_t nuns = 0U;
+	uint64_t sum = 0U;
+	const char *ln;
+	ssize_t lz;
+	rdln_t rd;
+
+	lseek(fd, 0, SEEK_SET);
+	rd = rdln_open(fd);
+	for (size_t i = 0U; (lz = rdln_getln(&ln, rd)) > 0; i++) {
+		unsigned char *const kb = key[i & 1U];
+
+		tokln1(of, NCOL, ln, lz);
+		k.z = 0U;
+		for (size_t j = 0U; j < NJC; j++) {
+			const size_t bo = of[j], eo = of[j + 1U];
+			k.z += key_enc(kb + k.z, kc[j], ln + bo, eo - bo - 1U);
+		}
+		k.k = kb;
+		k.pfx = key_pfx(kb, k.z);
+		if (checkp && i && key_cmp(&pk, &k) > 0) {
+			nuns++;
+		}
+		pk = k;
+		sum += k.pfx;
+	}
+	rdln_close(rd);
+	/* keep the compiler from dropping the loop */
+	return nuns + !sum;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	const size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000000U;
+	uint64_t t1 = UINT64_MAX, t2 = UINT64_MAX;
+	size_t r = 0U;
+
+	if (mklines(n) < 0) {
+		perror("Error: cannot create lines");
+		return 1;
+	}
+	/* warm up */
+	run(0);
+
+	/* interleave the paths, best of NRUN each */
+	for (size_t i = 0U; i < NRUN; i++) {
+		uint64_t t0 = now(), t;
+
+		r += run(0);
+		t = now();
+		t1 = t - t0 < t1 ? t - t0 : t1;
+		r += run(1);
+		t0 = now();
+		t2 = t0 - t < t2 ? t0 - t : t2;
+	}
+
+	printf("lines\t%zu\n", nln);
+	printf("plain\t%" PRIu64 "ms\t%" PRIu64 "ns/line\n",
+	       t1 / 1000000U, t1 / nln);
+	printf("check\t%" PRIu64 "ms\t%" PRIu64 "ns/line\n",
+	       t2 / 1000000U, t2 / nln);
+	printf("overhead\t%.1f%%\n", (double)t2 * 100 / (double)t1 - 100);
+	close(fd);
+	return r != 0U;
+}
+
+/* bench_sort.c ends here */